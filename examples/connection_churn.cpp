@@ -0,0 +1,67 @@
+#include "../src/netlib.hpp"
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Connection churn benchmark: a number of client threads connect and disconnect
+// as fast as they can, while the server accepts and tears the connections down.
+// Usage: connection_churn [client threads] [seconds]
+
+int main(int argc, char** argv) {
+  using namespace std::chrono_literals;
+  const uint16_t port = 9797;
+  std::size_t thread_count = (argc > 1) ? std::atol(argv[1]) : 4;
+  std::chrono::seconds duration((argc > 2) ? std::atol(argv[2]) : 5);
+
+  netlib::server server;
+  std::error_condition server_create_res = server.create("127.0.0.1",
+                                                         port,
+                                                         netlib::AddressFamily::IPv4,
+                                                         netlib::AddressProtocol::TCP);
+  if (server_create_res) {
+    std::cerr << "Error initializing server: " << server_create_res.message() << std::endl;
+    return 1;
+  }
+
+  std::atomic<bool> running = true;
+  std::atomic<std::size_t> connects = 0;
+  std::atomic<std::size_t> failures = 0;
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < thread_count; ++i) {
+    threads.emplace_back([&]() {
+      while (running) {
+        netlib::client client;
+        if (client.connect("127.0.0.1", port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms)) {
+          failures++;
+          continue;
+        }
+        connects++;
+      }
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(duration);
+  running = false;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // give the server a moment to notice the last disconnects
+  std::size_t remaining = server.get_client_count();
+  for (int i = 0; (i < 100) && remaining; ++i) {
+    std::this_thread::sleep_for(10ms);
+    remaining = server.get_client_count();
+  }
+
+  std::size_t accepted = 0;
+  for (const auto& stats : server.get_shard_stats()) {
+    accepted += stats.accepted_connections;
+  }
+  std::cout << "connects: " << connects << ", failures: " << failures << ", accepted: " << accepted << std::endl;
+  std::cout << "connects/s: " << static_cast<std::size_t>(connects / seconds) << std::endl;
+  std::cout << "connections left on server: " << remaining << std::endl;
+  return remaining == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#include "../src/netlib.hpp"
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+// Datagram throughput benchmark: one client pushes small datagrams in batches
+// at a datagram server on loopback, with or without UDP GSO.
+// Usage: datagram_blast [datagram size] [seconds] [gso 0/1]
+
+int main(int argc, char** argv) {
+  using namespace std::chrono_literals;
+  const uint16_t port = 9798;
+  std::size_t datagram_size = (argc > 1) ? std::atol(argv[1]) : 64;
+  std::chrono::seconds duration((argc > 2) ? std::atol(argv[2]) : 5);
+  bool gso = (argc > 3) ? (std::atol(argv[3]) != 0) : true;
+
+  netlib::server server;
+  std::atomic<std::size_t> received = 0;
+  server.register_callback_on_datagram(
+      [&](const netlib::datagram_endpoint &source, std::span<const uint8_t> data) -> netlib::server_response {
+        received++;
+        return {};
+      });
+  std::error_condition server_create_res = server.create("127.0.0.1",
+                                                         port,
+                                                         netlib::AddressFamily::IPv4,
+                                                         netlib::AddressProtocol::UDP,
+                                                         {.datagram_recv_buffer_size = 8 * 1024 * 1024});
+  if (server_create_res) {
+    std::cerr << "Error initializing server: " << server_create_res.message() << std::endl;
+    return 1;
+  }
+
+  netlib::client client;
+  std::error_condition connect_res = client.connect("127.0.0.1", port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::UDP);
+  if (connect_res) {
+    std::cerr << "Error connecting: " << connect_res.message() << std::endl;
+    return 1;
+  }
+  client.set_gso(gso);
+
+  const std::vector<std::vector<uint8_t>> batch(1024, std::vector<uint8_t>(datagram_size, 0x42));
+  std::size_t sent = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - start < duration) {
+    sent += client.send_batch(batch).first;
+  }
+  std::this_thread::sleep_for(200ms);
+  double seconds = std::chrono::duration<double>(duration).count();
+  std::cout << "Sent " << static_cast<std::size_t>(sent / seconds) << " datagrams/s, server received "
+            << static_cast<std::size_t>(received / seconds) << " datagrams/s" << std::endl;
+  server.stop();
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include "../src/netlib.hpp"
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Dispatch benchmark: many connections each send single bytes, so nearly every
+// readiness event carries one tiny request and the cost of handing events to the
+// workers dominates. Needs two descriptors per connection.
+// Usage: dispatch_overhead [connections] [seconds] [sender threads]
+
+static double cpu_seconds() {
+#ifndef _WIN32
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+  return 0.0;
+#endif
+}
+
+int main(int argc, char** argv) {
+  using namespace std::chrono_literals;
+  const uint16_t port = 9799;
+  std::size_t connection_count = (argc > 1) ? std::atol(argv[1]) : 10000;
+  std::chrono::seconds duration((argc > 2) ? std::atol(argv[2]) : 5);
+  std::size_t thread_count = (argc > 3) ? std::atol(argv[3]) : 4;
+
+#ifndef _WIN32
+  rlimit fd_limit{};
+  getrlimit(RLIMIT_NOFILE, &fd_limit);
+  fd_limit.rlim_cur = fd_limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &fd_limit);
+#endif
+
+  netlib::server server;
+  std::atomic<std::size_t> requests = 0;
+  server.register_callback_on_recv_span(
+      [&](netlib::client_endpoint endpoint, std::span<const uint8_t> data) -> netlib::server_response {
+        requests += data.size();
+        return {};
+      });
+  std::error_condition server_create_res = server.create("127.0.0.1",
+                                                         port,
+                                                         netlib::AddressFamily::IPv4,
+                                                         netlib::AddressProtocol::TCP);
+  if (server_create_res) {
+    std::cerr << "Error initializing server: " << server_create_res.message() << std::endl;
+    return 1;
+  }
+
+  // plain blocking sockets, a netlib::client per connection would bring its own thread pool
+  sockaddr_in server_addr{};
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr);
+  std::vector<netlib::socket> clients(connection_count);
+  for (auto& client : clients) {
+    std::error_condition create_res = client.create(AF_INET, SOCK_STREAM, 0);
+    if (create_res || ::connect(client.get_raw().value(), reinterpret_cast<sockaddr*>(&server_addr), sizeof(server_addr))) {
+      std::cerr << "Error connecting: " << (create_res ? create_res : netlib::socket_get_last_error()).message() << std::endl;
+      return 1;
+    }
+  }
+
+  std::atomic<bool> running = true;
+  std::atomic<std::size_t> sent = 0;
+  std::vector<std::thread> threads;
+  const uint8_t request = 1;
+  for (std::size_t t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&, t]() {
+      while (running) {
+        for (std::size_t i = t; (i < clients.size()) && running; i += thread_count) {
+          if (::send(clients[i].get_raw().value(), reinterpret_cast<const char*>(&request), 1, MSG_NOSIGNAL) == 1) {
+            sent++;
+          }
+        }
+      }
+    });
+  }
+
+  const double cpu_start = cpu_seconds();
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(duration);
+  running = false;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // let the server catch up with what is still in flight
+  for (int i = 0; (i < 100) && (requests < sent); ++i) {
+    std::this_thread::sleep_for(10ms);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double cpu = cpu_seconds() - cpu_start;
+
+  std::size_t events = 0;
+  std::size_t tasks = 0;
+  for (const auto& stats : server.get_shard_stats()) {
+    events += stats.dispatched_events;
+    tasks += stats.dispatch_tasks;
+  }
+  std::cout << "connections: " << connection_count << ", bytes sent: " << sent << ", received: " << requests << std::endl;
+  std::cout << "events/s: " << static_cast<std::size_t>(events / seconds) << std::endl;
+  std::cout << "events per pool task: " << (tasks ? static_cast<double>(events) / tasks : 0.0) << std::endl;
+  std::cout << "process cpu time per event: " << (events ? cpu * 1e9 / events : 0.0) << " ns" << std::endl;
+  server.stop();
+  for (auto& client : clients) {
+    client.close();
+  }
+  return requests == sent ? 0 : 1;
+}
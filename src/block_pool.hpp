@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace netlib {
+
+/*!
+ * @brief Recycles fixed size blocks of memory, for small objects which are created and
+ * destroyed at a high rate, like the shared state behind a `std::future`.
+ *
+ * Requests bigger than the block size, or with a stricter alignment than `new` guarantees,
+ * are passed on to `operator new`. Up to \p max_cached free blocks are kept around,
+ * anything beyond that is freed.
+ */
+class block_pool {
+private:
+    struct free_block {
+        free_block *next;
+    };
+
+    std::mutex _mutex;
+    free_block *_free_blocks = nullptr;
+    std::size_t _cached_count = 0;
+    std::size_t _block_size;
+    std::size_t _max_cached;
+    std::atomic<std::size_t> _allocation_count = 0;
+
+    block_pool(std::size_t block_size, std::size_t max_cached)
+        : _block_size(std::max(block_size, sizeof(free_block))), _max_cached(max_cached)
+    {
+    }
+
+    [[nodiscard]] bool is_pooled(std::size_t bytes, std::size_t alignment) const
+    {
+        return (bytes <= _block_size) && (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+    }
+
+public:
+    static constexpr std::size_t DEFAULT_BLOCK_SIZE = 128;
+    static constexpr std::size_t DEFAULT_MAX_CACHED = 4096;
+
+    static std::shared_ptr<block_pool> create(std::size_t block_size = DEFAULT_BLOCK_SIZE,
+                                              std::size_t max_cached = DEFAULT_MAX_CACHED)
+    {
+        return std::shared_ptr<block_pool>(new block_pool(block_size, max_cached));
+    }
+
+    block_pool(const block_pool &) = delete;
+    block_pool &operator=(const block_pool &) = delete;
+
+    ~block_pool()
+    {
+        while (_free_blocks) {
+            ::operator delete(std::exchange(_free_blocks, _free_blocks->next));
+        }
+    }
+
+    void *allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (!is_pooled(bytes, alignment)) {
+            return ::operator new(bytes, std::align_val_t(alignment));
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_free_blocks) {
+                _cached_count--;
+                return std::exchange(_free_blocks, _free_blocks->next);
+            }
+        }
+        _allocation_count++;
+        return ::operator new(_block_size);
+    }
+
+    void deallocate(void *block, std::size_t bytes, std::size_t alignment)
+    {
+        if (!is_pooled(bytes, alignment)) {
+            ::operator delete(block, std::align_val_t(alignment));
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_cached_count < _max_cached) {
+                _free_blocks = ::new (block) free_block{_free_blocks};
+                _cached_count++;
+                return;
+            }
+        }
+        ::operator delete(block);
+    }
+
+    [[nodiscard]] std::size_t get_block_size() const
+    {
+        return _block_size;
+    }
+
+    // amount of blocks which had to be allocated since the pool was created
+    [[nodiscard]] std::size_t get_allocation_count() const
+    {
+        return _allocation_count;
+    }
+
+    std::size_t get_cached_count()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _cached_count;
+    }
+};
+
+/*!
+ * @brief Standard allocator handing out blocks of a `block_pool`. Every copy keeps the pool
+ * alive, so whatever was allocated may outlive the owner of the pool.
+ */
+template <typename T> class pooled_allocator {
+private:
+    template <typename U> friend class pooled_allocator;
+    std::shared_ptr<block_pool> _pool;
+
+public:
+    using value_type = T;
+
+    explicit pooled_allocator(std::shared_ptr<block_pool> pool) : _pool(std::move(pool))
+    {
+    }
+    template <typename U> pooled_allocator(const pooled_allocator<U> &other) : _pool(other._pool) // NOLINT
+    {
+    }
+
+    T *allocate(std::size_t count)
+    {
+        return static_cast<T *>(_pool->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *pointer, std::size_t count)
+    {
+        _pool->deallocate(pointer, count * sizeof(T), alignof(T));
+    }
+
+    template <typename U> bool operator==(const pooled_allocator<U> &rhs) const
+    {
+        return _pool == rhs._pool;
+    }
+};
+
+} // namespace netlib
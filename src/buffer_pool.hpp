@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace netlib {
+
+class pooled_buffer;
+
+/*!
+ * @brief Recycles fixed size slabs of memory, so receiving data doesn't need to
+ * allocate once the pool is warmed up.
+ *
+ * Slabs are handed out as `pooled_buffer` objects, which give their slab back
+ * when destroyed. Up to \p max_cached free slabs are kept around, anything beyond
+ * that is freed. Buffers keep the pool alive, so they may outlive their owner.
+ */
+class buffer_pool : public std::enable_shared_from_this<buffer_pool> {
+private:
+    friend class pooled_buffer;
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<uint8_t[]>> _free_slabs;
+    std::size_t _slab_size;
+    std::size_t _max_cached;
+    std::atomic<std::size_t> _allocation_count = 0;
+
+    buffer_pool(std::size_t slab_size, std::size_t max_cached) : _slab_size(slab_size), _max_cached(max_cached)
+    {
+        // reserved up front, so giving slabs back never allocates
+        _free_slabs.reserve(max_cached);
+    }
+
+    void release(std::unique_ptr<uint8_t[]> slab)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_free_slabs.size() < _max_cached) {
+            _free_slabs.push_back(std::move(slab));
+        }
+    }
+
+public:
+    static constexpr std::size_t DEFAULT_SLAB_SIZE = 16 * 1024;
+    static constexpr std::size_t DEFAULT_MAX_CACHED = 1024;
+
+    static std::shared_ptr<buffer_pool> create(std::size_t slab_size = DEFAULT_SLAB_SIZE, std::size_t max_cached = DEFAULT_MAX_CACHED)
+    {
+        return std::shared_ptr<buffer_pool>(new buffer_pool(slab_size, max_cached));
+    }
+
+    inline pooled_buffer acquire();
+
+    // allocates up to \p count slabs into the cache right away. They are written to once, so their pages are
+    // placed on the NUMA node of the calling thread, not on the one of whichever thread receives into them first
+    void prefill(std::size_t count)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        while ((count-- > 0) && (_free_slabs.size() < _max_cached)) {
+            auto slab = std::unique_ptr<uint8_t[]>(new uint8_t[_slab_size]);
+            std::memset(slab.get(), 0, _slab_size);
+            _free_slabs.push_back(std::move(slab));
+            _allocation_count++;
+        }
+    }
+
+    [[nodiscard]] std::size_t get_slab_size() const
+    {
+        return _slab_size;
+    }
+
+    // amount of slabs which had to be allocated since the pool was created
+    [[nodiscard]] std::size_t get_allocation_count() const
+    {
+        return _allocation_count;
+    }
+
+    std::size_t get_cached_count()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _free_slabs.size();
+    }
+};
+
+/*!
+ * @brief Move-only view of a slab from a `buffer_pool`, holding between 0 and
+ * `capacity()` valid bytes. The slab goes back to the pool on destruction.
+ */
+class pooled_buffer {
+private:
+    std::shared_ptr<buffer_pool> _pool;
+    std::unique_ptr<uint8_t[]> _slab;
+    std::size_t _size = 0;
+    std::size_t _capacity = 0;
+
+public:
+    pooled_buffer() = default;
+    pooled_buffer(std::shared_ptr<buffer_pool> pool, std::unique_ptr<uint8_t[]> slab, std::size_t capacity)
+        : _pool(std::move(pool)), _slab(std::move(slab)), _capacity(capacity)
+    {
+    }
+
+    pooled_buffer(pooled_buffer &&other) noexcept
+        : _pool(std::move(other._pool)), _slab(std::move(other._slab)), _size(std::exchange(other._size, 0)),
+          _capacity(std::exchange(other._capacity, 0))
+    {
+    }
+    pooled_buffer &operator=(pooled_buffer &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            _pool = std::move(other._pool);
+            _slab = std::move(other._slab);
+            _size = std::exchange(other._size, 0);
+            _capacity = std::exchange(other._capacity, 0);
+        }
+        return *this;
+    }
+    pooled_buffer(const pooled_buffer &) = delete;
+    pooled_buffer &operator=(const pooled_buffer &) = delete;
+
+    ~pooled_buffer()
+    {
+        reset();
+    }
+
+    // gives the slab back to its pool early
+    void reset()
+    {
+        if (_pool && _slab) {
+            _pool->release(std::move(_slab));
+        }
+        _pool.reset();
+        _slab.reset();
+        _size = 0;
+        _capacity = 0;
+    }
+
+    [[nodiscard]] uint8_t *data()
+    {
+        return _slab.get();
+    }
+
+    [[nodiscard]] const uint8_t *data() const
+    {
+        return _slab.get();
+    }
+
+    [[nodiscard]] std::size_t size() const
+    {
+        return _size;
+    }
+
+    [[nodiscard]] std::size_t capacity() const
+    {
+        return _capacity;
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return _size == 0;
+    }
+
+    // marks the first \p size bytes as valid, never reallocates
+    void resize(std::size_t size)
+    {
+        assert(size <= _capacity);
+        _size = size;
+    }
+
+    [[nodiscard]] std::span<const uint8_t> get_span() const
+    {
+        return {_slab.get(), _size};
+    }
+
+    [[nodiscard]] const uint8_t *begin() const
+    {
+        return _slab.get();
+    }
+
+    [[nodiscard]] const uint8_t *end() const
+    {
+        return _slab.get() + _size;
+    }
+};
+
+inline pooled_buffer buffer_pool::acquire()
+{
+    std::unique_ptr<uint8_t[]> slab;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_free_slabs.empty()) {
+            slab = std::move(_free_slabs.back());
+            _free_slabs.pop_back();
+        }
+    }
+    if (!slab) {
+        // default initialized, since the memory gets overwritten by recv anyway
+        slab = std::unique_ptr<uint8_t[]>(new uint8_t[_slab_size]);
+        _allocation_count++;
+    }
+    return {shared_from_this(), std::move(slab), _slab_size};
+}
+
+} // namespace netlib
@@ -1,12 +1,16 @@
 #pragma once
+#include "datagram_operations.hpp"
 #include "endpoint_accessor.hpp"
+#include "framer.hpp"
 #include "service_resolver.hpp"
 #include "socket.hpp"
 #include "socket_operations.hpp"
 #include "thread_pool.hpp"
+#include <array>
 #include <future>
 #include <iostream>
 #include <optional>
+#include <span>
 #include <variant>
 #include <vector>
 
@@ -19,13 +23,78 @@ class client {
 protected:
     std::optional<netlib::socket> _socket;
     addrinfo *_endpoint_addr = nullptr;
-    netlib::thread_pool _thread_pool = netlib::thread_pool::create<1,1>();
+    // runs the async operations, the default pool of the process unless the client was given one.
+    // Only looked up on the first async operation, so constructing a client starts no threads
+    std::shared_ptr<netlib::thread_pool> _thread_pool;
+    task_tracker _async_tasks;
+    TaskPriority _async_priority = TaskPriority::normal;
+    frame_reader _frame_reader;
+    // frames which arrived together with an earlier one, handed out by the next `recv_frame` calls,
+    // starting at _next_frame. A vector, unlike a deque, doesn't allocate before it is used
+    std::vector<std::vector<uint8_t>> _frames;
+    std::size_t _next_frame = 0;
+    bool _gso = false;
+    // reused by every `send_batch`, along with the amount of datagrams each slot carries
+    std::vector<datagram_send_slot> _send_slots;
+    std::vector<std::size_t> _send_slot_counts;
+    // sends gathered while coalescing, written by `flush`
+    std::vector<uint8_t> _coalesced;
+    std::size_t _coalesce_bytes = 0;
+
+    // UDP_SEGMENT is limited to 64 segments per send, and to the size of a single datagram in total
+    static constexpr std::size_t MAX_GSO_SEGMENTS = 64;
+    static constexpr std::size_t MAX_GSO_PAYLOAD = 65507;
+
+    // groups runs of equally sized datagrams into one GSO send each, only the last of a run may be shorter
+    void build_send_slots(std::span<const std::span<const uint8_t>> datagrams)
+    {
+        _send_slots.clear();
+        _send_slot_counts.clear();
+        std::size_t first = 0;
+        while (first < datagrams.size()) {
+            const std::size_t segment_size = datagrams[first].size();
+            std::size_t end = first + 1;
+            std::size_t total_size = segment_size;
+            if (_gso && (segment_size > 0)) {
+                while ((end < datagrams.size()) && (end - first < MAX_GSO_SEGMENTS) && (datagrams[end].size() > 0) &&
+                       (datagrams[end].size() <= segment_size) && (total_size + datagrams[end].size() <= MAX_GSO_PAYLOAD)) {
+                    total_size += datagrams[end].size();
+                    end++;
+                    if (datagrams[end - 1].size() < segment_size) {
+                        break;
+                    }
+                }
+            }
+            _send_slots.push_back({.destination = nullptr,
+                                   .parts = datagrams.subspan(first, end - first),
+                                   .segment_size = (end - first > 1) ? segment_size : 0});
+            _send_slot_counts.push_back(end - first);
+            first = end;
+        }
+    }
+
+    template <typename FUNCTION> auto run_async(FUNCTION &&function)
+    {
+        if (!_thread_pool) {
+            _thread_pool = netlib::thread_pool::get_default();
+        }
+        // the token keeps the destructor waiting until the task is done with this client
+        return _thread_pool->add_task(_async_priority, [token = _async_tasks.acquire(), function = std::forward<FUNCTION>(function)]() mutable {
+            return function();
+        });
+    }
 public:
     client()
     {
         netlib::socket::initialize_system();
     }
-    client(netlib::socket sock, addrinfo *endpoint)
+    // async operations run on \p executor, which may be shared with other clients and servers
+    explicit client(std::shared_ptr<netlib::thread_pool> executor) : _thread_pool(std::move(executor))
+    {
+        netlib::socket::initialize_system();
+    }
+    client(netlib::socket sock, addrinfo *endpoint, std::shared_ptr<netlib::thread_pool> executor = nullptr)
+        : _thread_pool(std::move(executor))
     {
         _socket = sock;
         _endpoint_addr = endpoint;
@@ -33,6 +102,8 @@ public:
     }
     virtual ~client()
     {
+        // async operations still queued or running use this client
+        _async_tasks.wait();
         disconnect();
     }
     inline std::error_condition connect(const std::string &host, const std::variant<std::string, uint16_t> &service,
@@ -44,6 +115,8 @@ public:
                 return ec;
             }
         }
+        _frames.clear();
+        _next_frame = 0;
         const std::string service_string =
             std::holds_alternative<uint16_t>(service) ? std::to_string(std::get<uint16_t>(service)) : std::get<std::string>(service);
         std::pair<addrinfo *, std::error_condition> addrinfo_result =
@@ -90,12 +163,9 @@ public:
                                                            AddressFamily address_family, AddressProtocol address_protocol,
                                                            std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
     {
-        return _thread_pool.add_task(
-            [&](const std::string &host, const std::variant<std::string, uint16_t> &service, netlib::AddressFamily address_family,
-                netlib::AddressProtocol address_protocol, std::chrono::milliseconds timeout) {
-                return this->connect(host, service, address_family, address_protocol, timeout);
-            },
-            host, service, address_family, address_protocol, timeout);
+        return run_async([this, host, service, address_family, address_protocol, timeout]() {
+            return this->connect(host, service, address_family, address_protocol, timeout);
+        });
     }
 
     /*!
@@ -107,11 +177,9 @@ public:
     inline std::future<std::pair<std::size_t, std::error_condition>> send_async(const std::vector<uint8_t> &data,
                                                                                 std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
     {
-        return _thread_pool.add_task(
-            [&](const std::vector<uint8_t> &data, std::chrono::milliseconds timeout) {
-                return this->send(data, timeout);
-            },
-            data, timeout);
+        return run_async([this, data, timeout]() {
+            return this->send(data, timeout);
+        });
     }
 
 
@@ -132,6 +200,16 @@ public:
     inline std::pair<std::size_t, std::error_condition> send(const std::vector<uint8_t> &data,
                                                              std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
     {
+        return send(std::span<const uint8_t>(data), timeout);
+    }
+
+    /*!
+     * @brief Send data to a server straight from caller owned memory, without copying it.
+     * See the vector overload for parameter reference.
+     */
+    inline std::pair<std::size_t, std::error_condition> send(std::span<const uint8_t> data,
+                                                             std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
+    {
 
         if (!is_connected()) {
             return {0, std::errc::not_connected};
@@ -141,6 +219,14 @@ public:
             return {0, std::errc::timed_out};
         }
 
+        if (_coalesce_bytes) {
+            _coalesced.insert(_coalesced.end(), data.begin(), data.end());
+            if (_coalesced.size() >= _coalesce_bytes) {
+                return {data.size(), flush(timeout).second};
+            }
+            return {data.size(), {}};
+        }
+
         auto send_result = netlib::operations::send(_socket.value(), data, timeout);
 
         if (send_result.second && send_result.second == std::errc::connection_aborted) {
@@ -149,6 +235,43 @@ public:
         return send_result;
     }
 
+    /*!
+     * @brief Gathers sends in memory and writes them with a single syscall, instead of one small
+     * segment per send. Gathered data goes out once \p max_bytes are reached, on `flush`, and
+     * before receiving, so request/response protocols need no explicit flush. TCP only.
+     *
+     * @param max_bytes 0 turns coalescing off, after flushing what was gathered.
+     *
+     * @remark While coalescing, `send` reports the bytes it gathered, and errors of the flush it triggered.
+     */
+    inline std::error_condition set_write_coalescing(std::size_t max_bytes, std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
+    {
+        std::error_condition flush_error = max_bytes ? std::error_condition{} : flush(timeout).second;
+        _coalesce_bytes = max_bytes;
+        return flush_error;
+    }
+
+    /*!
+     * @brief Writes everything gathered while coalescing. What couldn't be sent within \p timeout stays gathered.
+     *
+     * @return Returns the amount of bytes sent and an error.
+     */
+    inline std::pair<std::size_t, std::error_condition> flush(std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
+    {
+        if (_coalesced.empty()) {
+            return {0, {}};
+        }
+        if (!is_connected()) {
+            return {0, std::errc::not_connected};
+        }
+        auto send_result = netlib::operations::send(_socket.value(), _coalesced, timeout);
+        _coalesced.erase(_coalesced.begin(), _coalesced.begin() + static_cast<std::ptrdiff_t>(send_result.first));
+        if (send_result.second == std::errc::connection_aborted) {
+            disconnect();
+        }
+        return send_result;
+    }
+
     /*!
      * @brief Recieve data from a server in async fashion. See `recv` for parameter reference.
      * @return Returns a future with the same contents that `recv` returns.
@@ -158,11 +281,9 @@ public:
     inline std::future<std::pair<std::vector<uint8_t>, std::error_condition>> recv_async(std::size_t byte_count = 0,
                                                                                          std::chrono::milliseconds timeout = 0ms)
     {
-        return _thread_pool.add_task(
-            [&](std::size_t byte_count, std::chrono::milliseconds timeout) {
-                return this->recv(byte_count, timeout);
-            },
-            byte_count, timeout);
+        return run_async([this, byte_count, timeout]() {
+            return this->recv(byte_count, timeout);
+        });
     }
 
     /*!
@@ -193,6 +314,10 @@ public:
         if (timeout.count() < 0) {
             return {{}, std::errc::timed_out};
         }
+        // the answer we're waiting for may depend on what is still gathered
+        if (std::error_condition flush_error = flush(timeout).second) {
+            return {{}, flush_error};
+        }
         auto recv_res = netlib::operations::recv(_socket.value(), byte_count, timeout);
         if (recv_res.second && recv_res.second != std::errc::timed_out) {
             disconnect();
@@ -200,13 +325,181 @@ public:
         return recv_res;
     }
 
+    /*!
+     * @brief Sets how `recv_frame` splits the received byte stream into messages.
+     */
+    inline void set_framer(std::shared_ptr<const framer> message_framer)
+    {
+        _frame_reader = frame_reader(std::move(message_framer));
+        _frames.clear();
+        _next_frame = 0;
+    }
+
+    /*!
+     * @brief Sets the lane of the thread pool the async operations of this client queue in. Clients
+     * moving bulk data can use `TaskPriority::low`, so they don't hold up latency sensitive work
+     * sharing the pool.
+     */
+    inline void set_async_priority(TaskPriority priority)
+    {
+        _async_priority = priority;
+    }
+
+    /*!
+     * @brief Receive exactly one message, as split by the framer given to `set_framer`.
+     *
+     * @param timeout The max amount of time that this function may wait for the message to complete.
+     * Parts of a message received before timing out are kept for the next call.
+     *
+     * @return Returns a pair with the payload of the message and an error. Returns \p invalid_argument
+     * if no framer was set, and \p message_size or \p bad_message if the stream could not be framed,
+     * in which case the client disconnects.
+     */
+    inline std::pair<std::vector<uint8_t>, std::error_condition> recv_frame(std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
+    {
+        if (!_frame_reader.has_framer()) {
+            return {{}, std::errc::invalid_argument};
+        }
+        if (std::error_condition flush_error = flush(timeout).second) {
+            return {{}, flush_error};
+        }
+        std::array<uint8_t, 16 * 1024> chunk{};
+        while (_next_frame == _frames.size()) {
+            if (!is_connected()) {
+                return {{}, std::errc::not_connected};
+            }
+            auto wait_res = netlib::operations::wait_for_operation(_socket->get_raw().value(), OperationClass::read, timeout);
+            if (wait_res.first) {
+                return {{}, wait_res.first};
+            }
+            timeout -= wait_res.second;
+            auto recv_res = netlib::operations::recv(_socket.value(), chunk.data(), chunk.size());
+            std::error_condition frame_error =
+                _frame_reader.feed(std::span<const uint8_t>(chunk.data(), recv_res.first), [&](std::span<const uint8_t> frame) {
+                    _frames.emplace_back(frame.begin(), frame.end());
+                    return std::error_condition{};
+                });
+            if (frame_error || (recv_res.second == std::errc::connection_aborted)) {
+                disconnect();
+                if (_next_frame == _frames.size()) {
+                    return {{}, frame_error ? frame_error : recv_res.second};
+                }
+            }
+        }
+        std::vector<uint8_t> frame = std::move(_frames[_next_frame++]);
+        if (_next_frame == _frames.size()) {
+            _frames.clear();
+            _next_frame = 0;
+        }
+        return {std::move(frame), {}};
+    }
+
+    /*!
+     * @brief Lets `send_batch` hand runs of equally sized datagrams to the kernel as one UDP GSO send,
+     * which splits them up again. Only has an effect on linux. Falls back to separate datagrams if the
+     * kernel or the route doesn't support it.
+     */
+    inline void set_gso(bool enable)
+    {
+        _gso = enable && datagram_operations::is_gso_supported();
+    }
+
+    /*!
+     * @brief Send many datagrams with as few syscalls as possible. Meant for UDP clients.
+     *
+     * @param datagrams The datagrams, each one is sent as is.
+     *
+     * @param timeout The max amount of time that this function may wait for room in the socket buffer.
+     *
+     * @return Returns a pair with the amount of datagrams sent and an error. The datagrams are sent in
+     * order, so the first ones up to the returned amount were sent.
+     */
+    inline std::pair<std::size_t, std::error_condition> send_batch(std::span<const std::span<const uint8_t>> datagrams,
+                                                                   std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
+    {
+        if (!is_connected()) {
+            return {0, std::errc::not_connected};
+        }
+        build_send_slots(datagrams);
+        std::size_t sent_slots = 0;
+        std::size_t sent_datagrams = 0;
+        while (sent_slots < _send_slots.size()) {
+            auto send_res = datagram_operations::send_batch(_socket.value(), std::span<const datagram_send_slot>(_send_slots).subspan(sent_slots));
+            for (std::size_t i = sent_slots; i < sent_slots + send_res.first; ++i) {
+                sent_datagrams += _send_slot_counts[i];
+            }
+            sent_slots += send_res.first;
+            if (!send_res.second) {
+                continue;
+            }
+            if (send_res.second == std::errc::operation_would_block) {
+                auto wait_res = netlib::operations::wait_for_operation(_socket->get_raw().value(), OperationClass::write, timeout);
+                timeout -= wait_res.second;
+                if (wait_res.first) {
+                    return {sent_datagrams, wait_res.first};
+                }
+                continue;
+            }
+            if (_gso && ((send_res.second == std::errc::invalid_argument) || (send_res.second == std::errc::io_error))) {
+                // no GSO for this socket, the remaining datagrams go out one by one
+                _gso = false;
+                auto fallback_res = send_batch(datagrams.subspan(sent_datagrams), timeout);
+                return {sent_datagrams + fallback_res.first, fallback_res.second};
+            }
+            return {sent_datagrams, send_res.second};
+        }
+        return {sent_datagrams, {}};
+    }
+
+    inline std::pair<std::size_t, std::error_condition> send_batch(const std::vector<std::vector<uint8_t>> &datagrams,
+                                                                   std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
+    {
+        std::vector<std::span<const uint8_t>> spans(datagrams.begin(), datagrams.end());
+        return send_batch(spans, timeout);
+    }
+
+    /*!
+     * @brief Receive many datagrams with as few syscalls as possible. Meant for UDP clients.
+     *
+     * @param slots Filled in order, see `datagram_recv_slot`. Every slot needs a buffer.
+     *
+     * @param timeout The max amount of time that this function may wait for the first datagram. Once
+     * there is one, everything that is pending right away is received, up to `slots.size()`.
+     *
+     * @return Returns a pair with the amount of filled slots and an error.
+     */
+    inline std::pair<std::size_t, std::error_condition> recv_batch(std::span<datagram_recv_slot> slots,
+                                                                   std::chrono::milliseconds timeout = DEFAULT_TIMEOUT)
+    {
+        if (!is_connected()) {
+            return {0, std::errc::not_connected};
+        }
+        auto wait_res = netlib::operations::wait_for_operation(_socket->get_raw().value(), OperationClass::read, timeout);
+        if (wait_res.first) {
+            return {0, wait_res.first};
+        }
+        auto recv_res = datagram_operations::recv_batch(_socket.value(), slots);
+        if ((recv_res.first > 0) && (recv_res.second == std::errc::operation_would_block)) {
+            // fewer datagrams than slots is the normal case
+            recv_res.second = {};
+        }
+        return recv_res;
+    }
+
     inline std::error_condition disconnect()
     {
         if (!_socket.has_value()) {
             return std::errc::not_connected;
         }
+        std::vector<uint8_t> coalesced;
+        coalesced.swap(_coalesced);
+        if (!coalesced.empty() && _socket->is_valid()) {
+            // best effort, a peer that doesn't take it right away won't get it
+            netlib::operations::send(_socket.value(), coalesced, 0ms);
+        }
         _socket->close();
         _socket.reset();
+        _frame_reader.reset();
 
         if (_endpoint_addr) {
             freeaddrinfo(_endpoint_addr);
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace netlib {
+
+/*!
+ * @brief Slab of per-connection state, addressed by generational handles.
+ *
+ * Slots live in fixed size chunks which are never moved or freed while the table
+ * exists, so a slot can be locked without holding any table wide lock, and all
+ * state of a connection sits next to its lock. Releasing a slot bumps its
+ * generation, which turns every handle to the previous occupant stale, even if the
+ * socket descriptor gets reused by the next connection right away.
+ * Insert, lookup and erase are O(1).
+ */
+template <typename T> class connection_table {
+public:
+    static constexpr uint32_t CHUNK_SIZE = 1024;
+    static constexpr uint32_t MAX_SLOTS = 1u << 24;
+
+    struct handle {
+        uint32_t index = MAX_SLOTS;
+        uint32_t generation = 0;
+    };
+
+    using locked_slot = std::pair<std::unique_lock<std::mutex>, T *>;
+
+private:
+    struct slot {
+        std::mutex mutex;
+        uint32_t generation = 1;
+        bool in_use = false;
+        T value{};
+    };
+    using chunk = std::array<slot, CHUNK_SIZE>;
+    static constexpr uint32_t MAX_CHUNKS = MAX_SLOTS / CHUNK_SIZE;
+
+    // fixed size directory, so readers never race with a reallocation
+    std::unique_ptr<std::atomic<chunk *>[]> _chunks = std::make_unique<std::atomic<chunk *>[]>(MAX_CHUNKS);
+    std::atomic<uint32_t> _capacity = 0;
+    std::atomic<std::size_t> _size = 0;
+    std::mutex _mutex;
+    std::vector<uint32_t> _free_slots;
+
+    slot &at(uint32_t index)
+    {
+        return (*_chunks[index / CHUNK_SIZE].load(std::memory_order_acquire))[index % CHUNK_SIZE];
+    }
+
+public:
+    connection_table() = default;
+
+    ~connection_table()
+    {
+        for (uint32_t i = 0; i < _capacity / CHUNK_SIZE; ++i) {
+            delete _chunks[i].load();
+        }
+    }
+
+    connection_table(const connection_table &) = delete;
+    connection_table &operator=(const connection_table &) = delete;
+
+    // reserves a free slot, returns nothing if the table is full
+    std::optional<handle> insert()
+    {
+        uint32_t index = 0;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_free_slots.empty()) {
+                uint32_t capacity = _capacity.load();
+                if (capacity == MAX_SLOTS) {
+                    return std::nullopt;
+                }
+                _chunks[capacity / CHUNK_SIZE].store(new chunk(), std::memory_order_release);
+                // reversed, so lower indices are handed out first and stay hot in cache
+                _free_slots.reserve(CHUNK_SIZE);
+                for (uint32_t i = CHUNK_SIZE; i > 0; --i) {
+                    _free_slots.push_back(capacity + i - 1);
+                }
+                _capacity.store(capacity + CHUNK_SIZE, std::memory_order_release);
+            }
+            index = _free_slots.back();
+            _free_slots.pop_back();
+        }
+        slot &s = at(index);
+        std::lock_guard<std::mutex> slot_lock(s.mutex);
+        s.in_use = true;
+        _size++;
+        return handle{.index = index, .generation = s.generation};
+    }
+
+    // locks the slot of \p h, the returned pointer is null if the handle is stale
+    locked_slot lock(handle h)
+    {
+        if (h.index >= _capacity.load(std::memory_order_acquire)) {
+            return {std::unique_lock<std::mutex>(), nullptr};
+        }
+        slot &s = at(h.index);
+        std::unique_lock<std::mutex> slot_lock(s.mutex);
+        if (!s.in_use || (s.generation != h.generation)) {
+            return {std::unique_lock<std::mutex>(), nullptr};
+        }
+        return {std::move(slot_lock), &s.value};
+    }
+
+    // frees the slot of \p h, which the caller must have locked via `lock`
+    void erase(handle h)
+    {
+        slot &s = at(h.index);
+        s.in_use = false;
+        s.generation++;
+        s.value = T{};
+        _size--;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _free_slots.push_back(h.index);
+    }
+
+    // calls \p func for every occupied slot, with that slot locked
+    template <typename FUNCTION> void for_each(FUNCTION &&func)
+    {
+        const uint32_t capacity = _capacity.load(std::memory_order_acquire);
+        for (uint32_t index = 0; index < capacity; ++index) {
+            slot &s = at(index);
+            std::lock_guard<std::mutex> slot_lock(s.mutex);
+            if (s.in_use) {
+                func(handle{.index = index, .generation = s.generation}, s.value);
+            }
+        }
+    }
+
+    [[nodiscard]] std::size_t size() const
+    {
+        return _size;
+    }
+};
+
+} // namespace netlib
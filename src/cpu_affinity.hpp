@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace netlib {
+
+enum class AffinityMode {
+    // threads run wherever the scheduler puts them
+    none,
+    // threads are pinned round robin to the cpus listed in `affinity_config::cpus`
+    cpu_list,
+    // one cpu per physical core, hyperthread siblings are left alone (linux only)
+    physical_cores,
+    // the cpus of the NUMA node `affinity_config::interface` is attached to, so threads stay next to
+    // the NIC queues and the memory they touch (linux only)
+    nic_node
+};
+
+struct affinity_config {
+    AffinityMode mode = AffinityMode::none;
+    std::vector<std::size_t> cpus;
+    // network interface name, like "eth0"
+    std::string interface;
+};
+
+/*!
+ * @brief Finds the cpus an `affinity_config` stands for, and pins threads to them. Topology is read
+ * from sysfs, so only explicit cpu lists work on other platforms.
+ */
+class cpu_affinity {
+private:
+    static std::pair<std::string, bool> read_first_line(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::string line;
+        if (!file || !std::getline(file, line)) {
+            return {{}, false};
+        }
+        return {line, true};
+    }
+
+public:
+    // parses the kernel's cpu list format, like "0-3,8,10-11"
+    static std::vector<std::size_t> parse_cpu_list(std::string_view list)
+    {
+        std::vector<std::size_t> cpus;
+        while (!list.empty()) {
+            const std::size_t comma = list.find(',');
+            std::string_view range = list.substr(0, comma);
+            list = (comma == std::string_view::npos) ? std::string_view{} : list.substr(comma + 1);
+            while (!range.empty() && ((range.back() == '\n') || (range.back() == ' '))) {
+                range.remove_suffix(1);
+            }
+            std::size_t first = 0;
+            auto [first_end, first_error] = std::from_chars(range.data(), range.data() + range.size(), first);
+            if (first_error != std::errc{}) {
+                continue;
+            }
+            std::size_t last = first;
+            if ((first_end != range.data() + range.size()) && (*first_end == '-')) {
+                if (std::from_chars(first_end + 1, range.data() + range.size(), last).ec != std::errc{}) {
+                    continue;
+                }
+            }
+            for (std::size_t cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    static std::vector<std::size_t> get_online_cpus()
+    {
+        auto [online, found] = read_first_line("/sys/devices/system/cpu/online");
+        std::vector<std::size_t> cpus = found ? parse_cpu_list(online) : std::vector<std::size_t>{};
+        if (cpus.empty()) {
+            for (std::size_t cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    /*!
+     * @brief The cpus threads get pinned to, one after another. Empty for `AffinityMode::none`.
+     *
+     * @return Returns \p invalid_argument for an empty cpu list or one naming offline cpus,
+     * \p no_such_device for an unknown interface, and \p not_supported if the topology can't be read.
+     */
+    static std::pair<std::vector<std::size_t>, std::error_condition> resolve(const affinity_config &config)
+    {
+        switch (config.mode) {
+        case AffinityMode::none:
+            // the default, every pool and server resolves it, so it mustn't touch sysfs
+            return {{}, {}};
+        case AffinityMode::cpu_list: {
+            if (config.cpus.empty()) {
+                return {{}, std::errc::invalid_argument};
+            }
+            const std::vector<std::size_t> online = get_online_cpus();
+            for (std::size_t cpu : config.cpus) {
+                if (std::find(online.begin(), online.end(), cpu) == online.end()) {
+                    return {{}, std::errc::invalid_argument};
+                }
+            }
+            return {config.cpus, {}};
+        }
+        case AffinityMode::physical_cores: {
+#ifdef _WIN32
+            return {{}, std::errc::not_supported};
+#else
+            std::vector<std::size_t> cores;
+            for (std::size_t cpu : get_online_cpus()) {
+                auto [siblings, found] =
+                    read_first_line("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+                std::vector<std::size_t> sibling_cpus = found ? parse_cpu_list(siblings) : std::vector<std::size_t>{};
+                // the lowest numbered sibling stands for the core
+                if (sibling_cpus.empty() || (*std::min_element(sibling_cpus.begin(), sibling_cpus.end()) == cpu)) {
+                    cores.push_back(cpu);
+                }
+            }
+            return {cores, {}};
+#endif
+        }
+        case AffinityMode::nic_node: {
+#ifdef _WIN32
+            return {{}, std::errc::not_supported};
+#else
+            if (config.interface.empty() || (config.interface.find('/') != std::string::npos)) {
+                return {{}, std::errc::invalid_argument};
+            }
+            if (!read_first_line("/sys/class/net/" + config.interface + "/type").second) {
+                return {{}, std::errc::no_such_device};
+            }
+            auto [node, found] = read_first_line("/sys/class/net/" + config.interface + "/device/numa_node");
+            // virtual interfaces and single node machines don't report one, then any cpu is as close as the next
+            if (!found || node.empty() || (node[0] == '-')) {
+                return {get_online_cpus(), {}};
+            }
+            auto [node_cpus, cpus_found] = read_first_line("/sys/devices/system/node/node" + node + "/cpulist");
+            std::vector<std::size_t> cpus = cpus_found ? parse_cpu_list(node_cpus) : std::vector<std::size_t>{};
+            if (cpus.empty()) {
+                return {{}, std::errc::not_supported};
+            }
+            return {cpus, {}};
+#endif
+        }
+        }
+        return {{}, std::errc::invalid_argument};
+    }
+
+    // pins the calling thread to \p cpu
+    static std::error_condition pin_current_thread(std::size_t cpu)
+    {
+#ifdef _WIN32
+        if (cpu >= sizeof(DWORD_PTR) * 8) {
+            return std::errc::invalid_argument;
+        }
+        if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) == 0) {
+            return std::errc::invalid_argument;
+        }
+        return {};
+#elif defined(__linux__)
+        if (cpu >= CPU_SETSIZE) {
+            return std::errc::invalid_argument;
+        }
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        if (int res = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set); res != 0) {
+            return std::generic_category().default_error_condition(res);
+        }
+        return {};
+#else
+        return std::errc::not_supported;
+#endif
+    }
+};
+
+} // namespace netlib
@@ -0,0 +1,258 @@
+#pragma once
+
+#include "socket.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#define NETLIB_HAS_MMSG
+#endif
+
+namespace netlib {
+
+// source or destination of a datagram, large enough for any address family
+struct datagram_endpoint {
+    sockaddr_storage addr{};
+    socklen_t addr_len = sizeof(sockaddr_storage);
+};
+
+// one datagram of a receive batch, `buffer` is caller owned and filled in place
+struct datagram_recv_slot {
+    std::span<uint8_t> buffer;
+    std::size_t size = 0;
+    datagram_endpoint source;
+    // with GRO, `buffer` may hold several datagrams of this size from the same source. 0 if not coalesced.
+    std::size_t segment_size = 0;
+    // the datagram didn't fit into `buffer` and was cut off
+    bool truncated = false;
+};
+
+// one datagram of a send batch, gathered from \p parts
+struct datagram_send_slot {
+    // nullptr for connected sockets
+    const datagram_endpoint *destination = nullptr;
+    std::span<const std::span<const uint8_t>> parts;
+    // with GSO, the kernel splits the payload into datagrams of this size. 0 sends a single datagram.
+    std::size_t segment_size = 0;
+};
+
+/*!
+ * @brief Batched datagram I/O. Uses `recvmmsg`/`sendmmsg` on linux, which move a whole batch
+ * with a single syscall, and falls back to one syscall per datagram elsewhere.
+ */
+class datagram_operations {
+private:
+    // upper bound for the datagrams moved by one syscall
+    static constexpr std::size_t MAX_BATCH_SIZE = 64;
+
+    static bool is_would_block(const std::error_condition &error)
+    {
+        return (error == std::errc::resource_unavailable_try_again) || (error == std::errc::operation_would_block);
+    }
+
+public:
+    // lets the kernel coalesce datagrams of one flow into a single receive, see `datagram_recv_slot::segment_size`
+    static bool set_gro(const netlib::socket &sock, bool enable = true)
+    {
+#ifdef NETLIB_HAS_MMSG
+        auto mode = static_cast<int32_t>(enable);
+        return setsockopt(sock.get_raw().value(), IPPROTO_UDP, UDP_GRO, &mode, sizeof(int32_t)) == 0;
+#else
+        return false;
+#endif
+    }
+
+    static bool is_gso_supported()
+    {
+#ifdef NETLIB_HAS_MMSG
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /*!
+     * @brief Receives up to `slots.size()` datagrams without blocking.
+     *
+     * @return Returns the amount of filled slots and an error. The error is \p operation_would_block
+     * if fewer datagrams than slots were pending.
+     */
+    static std::pair<std::size_t, std::error_condition> recv_batch(const netlib::socket &sock, std::span<datagram_recv_slot> slots)
+    {
+        std::size_t received = 0;
+#ifdef NETLIB_HAS_MMSG
+        std::array<mmsghdr, MAX_BATCH_SIZE> headers{};
+        std::array<iovec, MAX_BATCH_SIZE> iovecs{};
+        // room for the GRO segment size of every datagram
+        std::array<std::array<char, CMSG_SPACE(sizeof(int))>, MAX_BATCH_SIZE> controls{};
+        while (received < slots.size()) {
+            const std::size_t batch_size = std::min(MAX_BATCH_SIZE, slots.size() - received);
+            for (std::size_t i = 0; i < batch_size; ++i) {
+                datagram_recv_slot &slot = slots[received + i];
+                slot.source.addr_len = sizeof(slot.source.addr);
+                iovecs[i] = {.iov_base = slot.buffer.data(), .iov_len = slot.buffer.size()};
+                headers[i].msg_hdr = {};
+                headers[i].msg_hdr.msg_name = &slot.source.addr;
+                headers[i].msg_hdr.msg_namelen = slot.source.addr_len;
+                headers[i].msg_hdr.msg_iov = &iovecs[i];
+                headers[i].msg_hdr.msg_iovlen = 1;
+                headers[i].msg_hdr.msg_control = controls[i].data();
+                headers[i].msg_hdr.msg_controllen = controls[i].size();
+            }
+            int32_t res = ::recvmmsg(sock.get_raw().value(), headers.data(), static_cast<uint32_t>(batch_size), MSG_DONTWAIT, nullptr);
+            if (res < 0) {
+                std::error_condition recv_error = socket_get_last_error();
+                if (recv_error == std::errc::interrupted) {
+                    continue;
+                }
+                return {received, is_would_block(recv_error) ? std::errc::operation_would_block : recv_error};
+            }
+            for (std::size_t i = 0; i < static_cast<std::size_t>(res); ++i) {
+                datagram_recv_slot &slot = slots[received + i];
+                slot.size = headers[i].msg_len;
+                slot.source.addr_len = headers[i].msg_hdr.msg_namelen;
+                slot.truncated = (headers[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+                slot.segment_size = 0;
+                for (cmsghdr *cmsg = CMSG_FIRSTHDR(&headers[i].msg_hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&headers[i].msg_hdr, cmsg)) {
+                    // unlike UDP_SEGMENT on the send side, the kernel reports the segment size as an int
+                    if ((cmsg->cmsg_level == IPPROTO_UDP) && (cmsg->cmsg_type == UDP_GRO) &&
+                        (cmsg->cmsg_len >= CMSG_LEN(sizeof(int)))) {
+                        int segment_size = 0;
+                        std::memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+                        slot.segment_size = (segment_size > 0) ? static_cast<std::size_t>(segment_size) : 0;
+                    }
+                }
+            }
+            received += static_cast<std::size_t>(res);
+            if (static_cast<std::size_t>(res) < batch_size) {
+                return {received, std::errc::operation_would_block};
+            }
+        }
+#else
+        while (received < slots.size()) {
+            datagram_recv_slot &slot = slots[received];
+            slot.source.addr_len = sizeof(slot.source.addr);
+            ssize_t res = ::recvfrom(sock.get_raw().value(), reinterpret_cast<char *>(slot.buffer.data()), static_cast<int32_t>(slot.buffer.size()),
+                                     0, reinterpret_cast<sockaddr *>(&slot.source.addr), &slot.source.addr_len);
+            if (res < 0) {
+                std::error_condition recv_error = socket_get_last_error();
+                if (recv_error == std::errc::interrupted) {
+                    continue;
+                }
+                if (recv_error == std::errc::message_size) {
+                    // windows reports truncation as an error, the buffer is filled anyway
+                    res = static_cast<ssize_t>(slot.buffer.size());
+                    slot.truncated = true;
+                } else {
+                    return {received, is_would_block(recv_error) ? std::errc::operation_would_block : recv_error};
+                }
+            } else {
+                slot.truncated = false;
+            }
+            slot.size = static_cast<std::size_t>(res);
+            slot.segment_size = 0;
+            received++;
+        }
+#endif
+        return {received, {}};
+    }
+
+    /*!
+     * @brief Sends the datagrams in order without blocking.
+     *
+     * @return Returns the amount of datagrams handed to the kernel and an error. The error is
+     * \p operation_would_block if the socket buffer filled up before all were sent.
+     */
+    static std::pair<std::size_t, std::error_condition> send_batch(const netlib::socket &sock, std::span<const datagram_send_slot> slots)
+    {
+        std::size_t sent = 0;
+#ifdef NETLIB_HAS_MMSG
+        std::array<mmsghdr, MAX_BATCH_SIZE> headers{};
+        std::array<std::array<char, CMSG_SPACE(sizeof(uint16_t))>, MAX_BATCH_SIZE> controls{};
+        // iovec has a non-const pointer, the kernel doesn't write to it when sending though
+        thread_local std::vector<iovec> iovecs;
+        while (sent < slots.size()) {
+            const std::size_t batch_size = std::min(MAX_BATCH_SIZE, slots.size() - sent);
+            iovecs.clear();
+            for (std::size_t i = 0; i < batch_size; ++i) {
+                for (std::span<const uint8_t> part : slots[sent + i].parts) {
+                    iovecs.push_back({.iov_base = const_cast<uint8_t *>(part.data()), .iov_len = part.size()});
+                }
+            }
+            std::size_t iovec_index = 0;
+            for (std::size_t i = 0; i < batch_size; ++i) {
+                const datagram_send_slot &slot = slots[sent + i];
+                headers[i].msg_hdr = {};
+                if (slot.destination) {
+                    headers[i].msg_hdr.msg_name = const_cast<sockaddr_storage *>(&slot.destination->addr);
+                    headers[i].msg_hdr.msg_namelen = slot.destination->addr_len;
+                }
+                headers[i].msg_hdr.msg_iov = iovecs.data() + iovec_index;
+                headers[i].msg_hdr.msg_iovlen = slot.parts.size();
+                iovec_index += slot.parts.size();
+                if (slot.segment_size) {
+                    headers[i].msg_hdr.msg_control = controls[i].data();
+                    headers[i].msg_hdr.msg_controllen = controls[i].size();
+                    cmsghdr *cmsg = CMSG_FIRSTHDR(&headers[i].msg_hdr);
+                    cmsg->cmsg_level = IPPROTO_UDP;
+                    cmsg->cmsg_type = UDP_SEGMENT;
+                    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                    const auto segment_size = static_cast<uint16_t>(slot.segment_size);
+                    std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+                }
+            }
+            int32_t res = ::sendmmsg(sock.get_raw().value(), headers.data(), static_cast<uint32_t>(batch_size), MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (res < 0) {
+                std::error_condition send_error = socket_get_last_error();
+                if (send_error == std::errc::interrupted) {
+                    continue;
+                }
+                return {sent, is_would_block(send_error) ? std::errc::operation_would_block : send_error};
+            }
+            sent += static_cast<std::size_t>(res);
+            if (res == 0) {
+                return {sent, std::errc::operation_would_block};
+            }
+        }
+#else
+        std::vector<uint8_t> gathered;
+        while (sent < slots.size()) {
+            const datagram_send_slot &slot = slots[sent];
+            gathered.clear();
+            for (std::span<const uint8_t> part : slot.parts) {
+                gathered.insert(gathered.end(), part.begin(), part.end());
+            }
+            const std::size_t segment_size = slot.segment_size ? slot.segment_size : std::max<std::size_t>(gathered.size(), 1);
+            // without GSO, segments are sent one by one
+            for (std::size_t offset = 0; (offset < gathered.size()) || (offset == 0); offset += segment_size) {
+                const std::size_t length = std::min(segment_size, gathered.size() - offset);
+                const sockaddr *destination = slot.destination ? reinterpret_cast<const sockaddr *>(&slot.destination->addr) : nullptr;
+                const socklen_t destination_len = slot.destination ? slot.destination->addr_len : 0;
+                ssize_t res = ::sendto(sock.get_raw().value(), reinterpret_cast<const char *>(gathered.data() + offset),
+                                       static_cast<int32_t>(length), MSG_NOSIGNAL, destination, destination_len);
+                if (res < 0) {
+                    std::error_condition send_error = socket_get_last_error();
+                    return {sent, is_would_block(send_error) ? std::errc::operation_would_block : send_error};
+                }
+                if (gathered.empty()) {
+                    break;
+                }
+            }
+            sent++;
+        }
+#endif
+        return {sent, {}};
+    }
+};
+
+} // namespace netlib
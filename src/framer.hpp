@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace netlib {
+
+enum class ByteOrder { little, big };
+
+struct frame_info {
+    // position and size of the payload within the frame
+    std::size_t payload_offset = 0;
+    std::size_t payload_size = 0;
+    // amount of bytes the whole frame occupies, including headers and delimiters
+    std::size_t frame_size = 0;
+};
+
+/*!
+ * @brief Splits a byte stream into messages.
+ *
+ * A framer is stateless and may be shared between any number of connections. All
+ * per connection state lives in a `frame_reader`, which asks the framer for the next
+ * frame whenever data arrives.
+ */
+class framer {
+private:
+    std::size_t _max_frame_size;
+
+public:
+    static constexpr std::size_t DEFAULT_MAX_FRAME_SIZE = 16 * 1024 * 1024;
+
+    explicit framer(std::size_t max_frame_size = DEFAULT_MAX_FRAME_SIZE) : _max_frame_size(max_frame_size)
+    {
+    }
+    virtual ~framer() = default;
+
+    /*!
+     * @brief Looks for a complete frame at the start of \p pending.
+     *
+     * @param scan_offset Amount of bytes of \p pending which were already inspected by an earlier
+     * call without finding a frame. Framers which have to search for something may resume from
+     * there and update it, so a large frame isn't rescanned on every read. It is reset to 0 by the
+     * caller once a frame was consumed.
+     *
+     * @return Returns the frame if one is complete, nothing if more data is needed, or
+     * \p message_size if the frame would exceed the maximum frame size.
+     */
+    virtual std::pair<std::optional<frame_info>, std::error_condition> parse(std::span<const uint8_t> pending,
+                                                                             std::size_t &scan_offset) const = 0;
+
+    [[nodiscard]] std::size_t get_max_frame_size() const
+    {
+        return _max_frame_size;
+    }
+};
+
+/*!
+ * @brief Frames that start with an unsigned length field of 1, 2, 4 or 8 bytes. By default, the
+ * length only counts the payload. With \p length_includes_header, it counts the length field too.
+ */
+class length_prefix_framer : public framer {
+private:
+    std::size_t _width;
+    ByteOrder _byte_order;
+    bool _length_includes_header;
+
+public:
+    explicit length_prefix_framer(std::size_t width = 4, ByteOrder byte_order = ByteOrder::big, bool length_includes_header = false,
+                                  std::size_t max_frame_size = DEFAULT_MAX_FRAME_SIZE)
+        : framer(max_frame_size), _width(std::clamp<std::size_t>(width, 1, sizeof(uint64_t))), _byte_order(byte_order),
+          _length_includes_header(length_includes_header)
+    {
+    }
+
+    std::pair<std::optional<frame_info>, std::error_condition> parse(std::span<const uint8_t> pending,
+                                                                     std::size_t &scan_offset) const override
+    {
+        if (pending.size() < _width) {
+            return {std::nullopt, {}};
+        }
+        uint64_t length = 0;
+        for (std::size_t i = 0; i < _width; ++i) {
+            const std::size_t byte_index = (_byte_order == ByteOrder::big) ? i : (_width - 1 - i);
+            length = (length << 8) | pending[byte_index];
+        }
+        if (_length_includes_header) {
+            if (length < _width) {
+                return {std::nullopt, std::errc::bad_message};
+            }
+            length -= _width;
+        }
+        if ((get_max_frame_size() < _width) || (length > get_max_frame_size() - _width)) {
+            return {std::nullopt, std::errc::message_size};
+        }
+        const std::size_t frame_size = _width + static_cast<std::size_t>(length);
+        if (pending.size() < frame_size) {
+            return {std::nullopt, {}};
+        }
+        return {frame_info{.payload_offset = _width, .payload_size = static_cast<std::size_t>(length), .frame_size = frame_size}, {}};
+    }
+};
+
+// frames which end with a delimiter, i.e. "\r\n". The delimiter is not part of the payload.
+class delimiter_framer : public framer {
+private:
+    std::vector<uint8_t> _delimiter;
+
+public:
+    explicit delimiter_framer(std::vector<uint8_t> delimiter, std::size_t max_frame_size = DEFAULT_MAX_FRAME_SIZE)
+        : framer(max_frame_size), _delimiter(std::move(delimiter))
+    {
+    }
+
+    std::pair<std::optional<frame_info>, std::error_condition> parse(std::span<const uint8_t> pending,
+                                                                     std::size_t &scan_offset) const override
+    {
+        if (_delimiter.empty()) {
+            return {std::nullopt, std::errc::invalid_argument};
+        }
+        // a delimiter may straddle the boundary of what was scanned before
+        const std::size_t search_start = (scan_offset >= _delimiter.size()) ? (scan_offset - _delimiter.size() + 1) : 0;
+        auto found = std::search(pending.begin() + static_cast<std::ptrdiff_t>(std::min(search_start, pending.size())), pending.end(),
+                                 _delimiter.begin(), _delimiter.end());
+        if (found == pending.end()) {
+            scan_offset = pending.size();
+            if (pending.size() > get_max_frame_size()) {
+                return {std::nullopt, std::errc::message_size};
+            }
+            return {std::nullopt, {}};
+        }
+        const auto payload_size = static_cast<std::size_t>(found - pending.begin());
+        if (payload_size + _delimiter.size() > get_max_frame_size()) {
+            return {std::nullopt, std::errc::message_size};
+        }
+        return {frame_info{.payload_offset = 0, .payload_size = payload_size, .frame_size = payload_size + _delimiter.size()}, {}};
+    }
+};
+
+class fixed_size_framer : public framer {
+private:
+    std::size_t _frame_size;
+
+public:
+    explicit fixed_size_framer(std::size_t frame_size) : framer(frame_size), _frame_size(frame_size)
+    {
+    }
+
+    std::pair<std::optional<frame_info>, std::error_condition> parse(std::span<const uint8_t> pending,
+                                                                     std::size_t &scan_offset) const override
+    {
+        if (_frame_size == 0) {
+            return {std::nullopt, std::errc::invalid_argument};
+        }
+        if (pending.size() < _frame_size) {
+            return {std::nullopt, {}};
+        }
+        return {frame_info{.payload_offset = 0, .payload_size = _frame_size, .frame_size = _frame_size}, {}};
+    }
+};
+
+using callback_parse_frame_t =
+    std::function<std::pair<std::optional<frame_info>, std::error_condition>(std::span<const uint8_t>, std::size_t &)>;
+
+// wraps a user supplied parse function, see `framer::parse` for its contract
+class custom_framer : public framer {
+private:
+    callback_parse_frame_t _parse;
+
+public:
+    explicit custom_framer(callback_parse_frame_t parse, std::size_t max_frame_size = DEFAULT_MAX_FRAME_SIZE)
+        : framer(max_frame_size), _parse(std::move(parse))
+    {
+    }
+
+    std::pair<std::optional<frame_info>, std::error_condition> parse(std::span<const uint8_t> pending,
+                                                                     std::size_t &scan_offset) const override
+    {
+        auto result = _parse(pending, scan_offset);
+        if (result.first && (result.first->frame_size > get_max_frame_size())) {
+            return {std::nullopt, std::errc::message_size};
+        }
+        if (!result.first && !result.second && (pending.size() > get_max_frame_size())) {
+            return {std::nullopt, std::errc::message_size};
+        }
+        return result;
+    }
+};
+
+/*!
+ * @brief Per connection reassembly state for a `framer`.
+ *
+ * Incoming data is parsed in place where possible. Only an incomplete frame at the end
+ * of a read is copied into the reader's own buffer, to be completed by later reads.
+ */
+class frame_reader {
+private:
+    std::shared_ptr<const framer> _framer;
+    std::vector<uint8_t> _pending;
+    std::size_t _scan_offset = 0;
+
+    // hands all complete frames in \p data to \p on_frame, returns the amount of bytes consumed
+    template <typename CALLBACK>
+    std::pair<std::size_t, std::error_condition> extract(std::span<const uint8_t> data, CALLBACK &&on_frame)
+    {
+        std::size_t consumed = 0;
+        while (consumed < data.size()) {
+            auto [frame, parse_error] = _framer->parse(data.subspan(consumed), _scan_offset);
+            if (parse_error) {
+                return {consumed, parse_error};
+            }
+            if (!frame) {
+                break;
+            }
+            if ((frame->frame_size == 0) || (frame->payload_offset + frame->payload_size > frame->frame_size) ||
+                (frame->frame_size > data.size() - consumed)) {
+                // a custom framer got it wrong, there's no way to continue from here
+                return {consumed, std::errc::bad_message};
+            }
+            _scan_offset = 0;
+            std::error_condition frame_error = on_frame(data.subspan(consumed + frame->payload_offset, frame->payload_size));
+            consumed += frame->frame_size;
+            if (frame_error) {
+                return {consumed, frame_error};
+            }
+        }
+        return {consumed, {}};
+    }
+
+public:
+    frame_reader() = default;
+    explicit frame_reader(std::shared_ptr<const framer> framer) : _framer(std::move(framer))
+    {
+    }
+
+    [[nodiscard]] bool has_framer() const
+    {
+        return _framer != nullptr;
+    }
+
+    // amount of bytes waiting for the rest of their frame
+    [[nodiscard]] std::size_t get_pending_size() const
+    {
+        return _pending.size();
+    }
+
+    /*!
+     * @brief Adds received data and calls \p on_frame with the payload of every completed frame, in order.
+     *
+     * @param on_frame Called as `std::error_condition(std::span<const uint8_t>)`. The span is only valid
+     * during the call. Returning an error stops processing, the remaining data is kept.
+     *
+     * @return Returns the first error of either the framer or \p on_frame. After a framer error, the
+     * stream can't be resynchronized and the connection should be closed.
+     */
+    template <typename CALLBACK> std::error_condition feed(std::span<const uint8_t> data, CALLBACK &&on_frame)
+    {
+        if (_pending.empty()) {
+            // common case, frames are handed out straight from the receive buffer
+            auto [consumed, error] = extract(data, on_frame);
+            _pending.assign(data.begin() + static_cast<std::ptrdiff_t>(consumed), data.end());
+            return error;
+        }
+        _pending.insert(_pending.end(), data.begin(), data.end());
+        auto [consumed, error] = extract(std::span<const uint8_t>(_pending), on_frame);
+        _pending.erase(_pending.begin(), _pending.begin() + static_cast<std::ptrdiff_t>(consumed));
+        return error;
+    }
+
+    void reset()
+    {
+        _pending.clear();
+        _scan_offset = 0;
+    }
+};
+
+} // namespace netlib
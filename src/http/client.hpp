@@ -8,11 +8,19 @@ using namespace std::chrono_literals;
 
 class http_client {
 private:
-    netlib::thread_pool _thread_pool;
+    std::shared_ptr<netlib::thread_pool> _thread_pool;
+    task_tracker _async_tasks;
     netlib::client _client;
 public:
 
     inline http_client() {}
+    // requests run on \p executor, which may be shared with other clients and servers
+    inline explicit http_client(std::shared_ptr<netlib::thread_pool> executor)
+        : _thread_pool(executor), _client(std::move(executor)) {}
+    inline ~http_client() {
+        // async requests still queued or running use this client
+        _async_tasks.wait();
+    }
 
     inline std::pair<std::optional<netlib::http::http_response>, std::error_condition> get(const std::string& url) {
         auto uri = URI(url);
@@ -68,11 +76,12 @@ public:
     }
 
     inline std::future<std::pair<std::optional<netlib::http::http_response>, std::error_condition>> get_async(const std::string& url) {
-        return _thread_pool.add_task(
-            [&](std::string url) {
-                return this->get(url);
-            },
-            url);
+        if (!_thread_pool) {
+            _thread_pool = netlib::thread_pool::get_default();
+        }
+        return _thread_pool->add_task([this, token = _async_tasks.acquire(), url]() {
+            return this->get(url);
+        });
     }
 
 
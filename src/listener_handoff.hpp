@@ -0,0 +1,126 @@
+#pragma once
+
+#include "socket.hpp"
+#include "socket_operations.hpp"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <span>
+#include <vector>
+
+namespace netlib {
+
+/*!
+ * @brief Passes listening sockets to another process over a connected unix domain socket, via
+ * `SCM_RIGHTS`. The receiver gets its own descriptors for the same sockets, so the backlog and
+ * the bound address survive the sender closing its copies.
+ *
+ * Typical restart: the old process sends `server::get_listeners()`, the new one passes the
+ * received descriptors to `server::adopt`, and the old one calls `server::stop_accepting` and
+ * finishes its remaining connections.
+ */
+class listener_handoff {
+private:
+    // a single message carries all descriptors, this is well below the kernel limit
+    static constexpr std::size_t MAX_LISTENERS = 64;
+
+public:
+    static std::error_condition send(const netlib::socket &channel, std::span<const socket_t> listeners)
+    {
+#ifdef _WIN32
+        return std::errc::not_supported;
+#else
+        if (listeners.empty() || (listeners.size() > MAX_LISTENERS)) {
+            return std::errc::invalid_argument;
+        }
+        // some platforms don't deliver ancillary data without at least one byte of payload
+        auto count = static_cast<uint8_t>(listeners.size());
+        iovec payload{.iov_base = &count, .iov_len = sizeof(count)};
+        std::vector<char> control(CMSG_SPACE(sizeof(socket_t) * listeners.size()));
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(socket_t) * listeners.size());
+        std::memcpy(CMSG_DATA(cmsg), listeners.data(), sizeof(socket_t) * listeners.size());
+        while (::sendmsg(channel.get_raw().value(), &message, MSG_NOSIGNAL) < 0) {
+            std::error_condition send_error = socket_get_last_error();
+            if (send_error != std::errc::interrupted) {
+                return send_error;
+            }
+        }
+        return {};
+#endif
+    }
+
+    /*!
+     * @brief Waits up to \p timeout for listeners sent via `send`. Like every descriptor of this lib, they
+     * are close-on-exec, so a process being upgraded doesn't leak them into whatever it runs next.
+     *
+     * @return Returns the received descriptors, which the caller owns, and an error.
+     */
+    static std::pair<std::vector<socket_t>, std::error_condition> receive(const netlib::socket &channel,
+                                                                          std::chrono::milliseconds timeout)
+    {
+#ifdef _WIN32
+        return {{}, std::errc::not_supported};
+#else
+        std::error_condition wait_error = operations::wait_for_operation(channel.get_raw().value(), OperationClass::read, timeout).first;
+        if (wait_error) {
+            return {{}, wait_error};
+        }
+        uint8_t count = 0;
+        iovec payload{.iov_base = &count, .iov_len = sizeof(count)};
+        std::array<char, CMSG_SPACE(sizeof(socket_t) * MAX_LISTENERS)> control{};
+        msghdr message{};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+#ifdef __linux__
+        // set atomically while installing them, no other thread's fork can get in between
+        constexpr int32_t recv_flags = MSG_CMSG_CLOEXEC;
+#else
+        constexpr int32_t recv_flags = 0;
+#endif
+        ssize_t res = 0;
+        do {
+            res = ::recvmsg(channel.get_raw().value(), &message, recv_flags);
+        } while ((res < 0) && (socket_get_last_error() == std::errc::interrupted));
+        if (res < 0) {
+            return {{}, socket_get_last_error()};
+        }
+        if (res == 0) {
+            return {{}, std::errc::connection_aborted};
+        }
+        std::vector<socket_t> listeners;
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+                const std::size_t fd_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(socket_t);
+                const std::size_t offset = listeners.size();
+                listeners.resize(offset + fd_count);
+                std::memcpy(listeners.data() + offset, CMSG_DATA(cmsg), sizeof(socket_t) * fd_count);
+            }
+        }
+        if ((message.msg_flags & MSG_CTRUNC) || (listeners.size() != count)) {
+            // whatever did arrive is of no use without the rest
+            for (socket_t fd : listeners) {
+                ::close(fd);
+            }
+            return {{}, std::errc::bad_message};
+        }
+#ifndef __linux__
+        for (socket_t fd : listeners) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        return {std::move(listeners), {}};
+#endif
+    }
+};
+
+} // namespace netlib
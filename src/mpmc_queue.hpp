@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace netlib {
+
+/*!
+ * @brief Bounded lock-free multi producer multi consumer queue, after Dmitry Vyukov's
+ * bounded MPMC queue.
+ *
+ * Every cell carries a sequence number telling producers and consumers whose turn it is,
+ * so both ends only need a single compare-and-swap on their position. The capacity is
+ * rounded up to a power of two and fixed, nothing is allocated after construction.
+ */
+template <typename T> class mpmc_queue {
+private:
+    static constexpr std::size_t CACHE_LINE = 64;
+
+    struct cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<cell[]> _cells;
+    std::size_t _mask;
+    // producers and consumers each hammer their own position, keep them apart
+    alignas(CACHE_LINE) std::atomic<std::size_t> _enqueue_pos = 0;
+    alignas(CACHE_LINE) std::atomic<std::size_t> _dequeue_pos = 0;
+
+public:
+    explicit mpmc_queue(std::size_t capacity)
+    {
+        std::size_t rounded = 2;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        _cells = std::make_unique<cell[]>(rounded);
+        _mask = rounded - 1;
+        for (std::size_t i = 0; i < rounded; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpmc_queue(const mpmc_queue &) = delete;
+    mpmc_queue &operator=(const mpmc_queue &) = delete;
+
+    // leaves \p value untouched and returns false if the queue is full
+    bool try_push(T &&value)
+    {
+        cell *target = nullptr;
+        std::size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            target = &_cells[pos & _mask];
+            const std::size_t sequence = target->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (difference == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // the consumer of the previous round hasn't freed the cell yet
+                return false;
+            } else {
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        target->value = std::move(value);
+        target->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // returns false if the queue is empty
+    bool try_pop(T &value)
+    {
+        cell *target = nullptr;
+        std::size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            target = &_cells[pos & _mask];
+            const std::size_t sequence = target->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (difference == 0) {
+                if (_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                pos = _dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(target->value);
+        target->sequence.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    [[nodiscard]] std::size_t capacity() const
+    {
+        return _mask + 1;
+    }
+};
+
+} // namespace netlib
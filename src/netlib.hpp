@@ -1,5 +1,6 @@
 #pragma once
 
 #include "client.hpp"
+#include "listener_handoff.hpp"
 #include "server.hpp"
 #include "thread_pool.hpp"
\ No newline at end of file
@@ -0,0 +1,509 @@
+#pragma once
+
+#include "socket.hpp"
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#define NETLIB_HAS_EPOLL
+#endif
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+namespace netlib {
+
+enum class ReactorBackend { automatic, epoll, poll, select };
+
+struct reactor_event {
+    // the value given when the socket was registered
+    uint64_t token = 0;
+    OperationClass events = OperationClass::read;
+};
+
+/*!
+ * @brief Readiness notification interface used by the server.
+ *
+ * All registrations are one-shot: once a socket was reported ready, it is not
+ * reported again until it is re-armed via `rearm`. This allows the processing
+ * thread to hand a socket to a worker without ever reporting it twice.
+ * Registrations are persistent between calls to `wait`, and every method
+ * except `wait` may be called from any thread. Each registration carries a
+ * caller defined token, which is what `wait` reports back.
+ */
+class reactor {
+protected:
+    // set by backends whose descriptors couldn't be created, `create` hands it out instead of the reactor
+    std::error_condition _init_error;
+
+public:
+    virtual ~reactor() = default;
+
+    virtual std::error_condition add(socket_t fd, OperationClass interest, uint64_t token) = 0;
+    virtual std::error_condition rearm(socket_t fd, OperationClass interest, uint64_t token) = 0;
+    virtual std::error_condition remove(socket_t fd) = 0;
+
+    /*!
+     * @brief Waits for readiness of registered sockets.
+     *
+     * @param events Cleared and then filled with all sockets that became ready.
+     *
+     * @param timeout Maximum time to block. A negative value blocks until either
+     * an event arrives or `wakeup` is called.
+     *
+     * @return Returns an error if the underlying syscall failed.
+     */
+    virtual std::error_condition wait(std::vector<reactor_event> &events, std::chrono::milliseconds timeout) = 0;
+
+    // interrupts a thread blocked in `wait`
+    virtual void wakeup() = 0;
+
+    [[nodiscard]] virtual ReactorBackend get_backend() const = 0;
+
+    /*!
+     * @brief Creates a reactor of the given backend, `automatic` picks the best one of the platform.
+     *
+     * @return Returns the error and no reactor if the descriptors it needs couldn't be created,
+     * for example because the process ran out of them.
+     */
+    static std::pair<std::unique_ptr<reactor>, std::error_condition> create(ReactorBackend backend = ReactorBackend::automatic);
+};
+
+/*!
+ * @brief Self-pipe used to interrupt poll/select. On windows, where these can't
+ * watch pipes, a loopback UDP socket connected to itself is used instead.
+ */
+class wakeup_channel {
+private:
+    socket_t _read_fd = INVALID_SOCKET;
+    socket_t _write_fd = INVALID_SOCKET;
+    std::error_condition _init_error;
+
+public:
+    wakeup_channel()
+    {
+#ifdef _WIN32
+        netlib::socket::initialize_system();
+        _read_fd = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (_read_fd == INVALID_SOCKET) {
+            _init_error = socket_get_last_error();
+            return;
+        }
+        sockaddr_in loopback{};
+        loopback.sin_family = AF_INET;
+        loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_len = sizeof(loopback);
+        if ((::bind(_read_fd, reinterpret_cast<sockaddr *>(&loopback), addr_len) != 0) ||
+            (::getsockname(_read_fd, reinterpret_cast<sockaddr *>(&loopback), &addr_len) != 0) ||
+            (::connect(_read_fd, reinterpret_cast<sockaddr *>(&loopback), addr_len) != 0)) {
+            _init_error = socket_get_last_error();
+        }
+        u_long mode = 1;
+        ioctlsocket(_read_fd, FIONBIO, &mode);
+        _write_fd = _read_fd;
+#else
+        std::array<int32_t, 2> fds{INVALID_SOCKET, INVALID_SOCKET};
+        if (::pipe(fds.data()) == 0) {
+            for (int32_t fd : fds) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            _read_fd = fds[0];
+            _write_fd = fds[1];
+        } else {
+            _init_error = socket_get_last_error();
+        }
+#endif
+    }
+
+    ~wakeup_channel()
+    {
+#ifdef _WIN32
+        closesocket(_read_fd);
+#else
+        ::close(_read_fd);
+        ::close(_write_fd);
+#endif
+    }
+
+    wakeup_channel(const wakeup_channel &) = delete;
+    wakeup_channel &operator=(const wakeup_channel &) = delete;
+
+    [[nodiscard]] socket_t get_fd() const
+    {
+        return _read_fd;
+    }
+
+    // without a working channel, nothing could interrupt a wait
+    [[nodiscard]] std::error_condition get_init_error() const
+    {
+        return _init_error;
+    }
+
+    void notify()
+    {
+        const char token = 1;
+#ifdef _WIN32
+        ::send(_write_fd, &token, 1, 0);
+#else
+        // a full pipe means a wakeup is already pending
+        [[maybe_unused]] ssize_t res = ::write(_write_fd, &token, 1);
+#endif
+    }
+
+    void drain()
+    {
+        std::array<char, 64> sink{};
+#ifdef _WIN32
+        while (::recv(_read_fd, sink.data(), static_cast<int32_t>(sink.size()), 0) > 0) {
+        }
+#else
+        while (::read(_read_fd, sink.data(), sink.size()) > 0) {
+        }
+#endif
+    }
+};
+
+#ifdef NETLIB_HAS_EPOLL
+class epoll_reactor : public reactor {
+private:
+    static constexpr std::size_t MAX_EVENTS_PER_WAIT = 256;
+    static constexpr uint64_t WAKEUP_TOKEN = UINT64_MAX;
+    int32_t _epoll_fd = INVALID_SOCKET;
+    int32_t _event_fd = INVALID_SOCKET;
+    std::array<epoll_event, MAX_EVENTS_PER_WAIT> _event_buffer{};
+
+    static uint32_t to_epoll_events(OperationClass interest)
+    {
+        uint32_t events = EPOLLONESHOT;
+        if ((interest == OperationClass::read) || (interest == OperationClass::both)) {
+            events |= EPOLLIN | EPOLLRDHUP;
+        }
+        if ((interest == OperationClass::write) || (interest == OperationClass::both)) {
+            events |= EPOLLOUT;
+        }
+        return events;
+    }
+
+    std::error_condition control(int32_t operation, socket_t fd, OperationClass interest, uint64_t token)
+    {
+        epoll_event ev{};
+        ev.events = to_epoll_events(interest);
+        ev.data.u64 = token;
+        if (::epoll_ctl(_epoll_fd, operation, fd, &ev) < 0) {
+            return socket_get_last_error();
+        }
+        return {};
+    }
+
+public:
+    epoll_reactor()
+    {
+        _epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (_epoll_fd < 0) {
+            _init_error = socket_get_last_error();
+            return;
+        }
+        _event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_event_fd < 0) {
+            _init_error = socket_get_last_error();
+            return;
+        }
+        // the eventfd is the only level-triggered, persistent registration
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = WAKEUP_TOKEN;
+        if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _event_fd, &ev) < 0) {
+            _init_error = socket_get_last_error();
+        }
+    }
+
+    ~epoll_reactor() override
+    {
+        if (_event_fd >= 0) {
+            ::close(_event_fd);
+        }
+        if (_epoll_fd >= 0) {
+            ::close(_epoll_fd);
+        }
+    }
+
+    std::error_condition add(socket_t fd, OperationClass interest, uint64_t token) override
+    {
+        // epoll_ctl takes effect for a concurrently blocked epoll_wait, no wakeup required
+        return control(EPOLL_CTL_ADD, fd, interest, token);
+    }
+
+    std::error_condition rearm(socket_t fd, OperationClass interest, uint64_t token) override
+    {
+        return control(EPOLL_CTL_MOD, fd, interest, token);
+    }
+
+    std::error_condition remove(socket_t fd) override
+    {
+        if (::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) < 0) {
+            return socket_get_last_error();
+        }
+        return {};
+    }
+
+    std::error_condition wait(std::vector<reactor_event> &events, std::chrono::milliseconds timeout) override
+    {
+        events.clear();
+        int32_t timeout_ms = (timeout.count() < 0) ? -1 : static_cast<int32_t>(timeout.count());
+        int32_t event_count = ::epoll_wait(_epoll_fd, _event_buffer.data(), static_cast<int32_t>(_event_buffer.size()), timeout_ms);
+        if (event_count < 0) {
+            std::error_condition wait_error = socket_get_last_error();
+            return (wait_error == std::errc::interrupted) ? std::error_condition{} : wait_error;
+        }
+        for (int32_t i = 0; i < event_count; ++i) {
+            const epoll_event &ev = _event_buffer[i];
+            if (ev.data.u64 == WAKEUP_TOKEN) {
+                uint64_t counter = 0;
+                [[maybe_unused]] ssize_t res = ::read(_event_fd, &counter, sizeof(counter));
+                continue;
+            }
+            // errors and hangups are reported as readiness, the following
+            // recv or send will surface the actual error
+            bool readable = ev.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+            bool writable = ev.events & (EPOLLOUT | EPOLLHUP | EPOLLERR);
+            OperationClass ready = (readable && writable) ? OperationClass::both : (readable ? OperationClass::read : OperationClass::write);
+            events.push_back({.token = ev.data.u64, .events = ready});
+        }
+        return {};
+    }
+
+    void wakeup() override
+    {
+        uint64_t counter = 1;
+        [[maybe_unused]] ssize_t res = ::write(_event_fd, &counter, sizeof(counter));
+    }
+
+    [[nodiscard]] ReactorBackend get_backend() const override
+    {
+        return ReactorBackend::epoll;
+    }
+};
+#endif
+
+/*!
+ * @brief Common base for the portable backends, which need to keep track of
+ * registrations themselves and rebuild their descriptor set on every wait.
+ */
+class table_reactor : public reactor {
+protected:
+    struct registration {
+        OperationClass interest = OperationClass::read;
+        uint64_t token = 0;
+        bool armed = true;
+    };
+    std::mutex _mutex;
+    std::map<socket_t, registration> _registrations;
+    wakeup_channel _wakeup;
+
+    table_reactor()
+    {
+        _init_error = _wakeup.get_init_error();
+    }
+
+    std::error_condition update(socket_t fd, OperationClass interest, uint64_t token, bool must_exist)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _registrations.find(fd);
+            if (must_exist && (it == _registrations.end())) {
+                return std::errc::no_such_file_or_directory;
+            }
+            if (!must_exist && (it != _registrations.end())) {
+                return std::errc::file_exists;
+            }
+            _registrations[fd] = {.interest = interest, .token = token, .armed = true};
+        }
+        _wakeup.notify();
+        return {};
+    }
+
+    // called with the results of the syscall, disarms every reported socket
+    void collect(socket_t fd, bool readable, bool writable, std::vector<reactor_event> &events)
+    {
+        auto it = _registrations.find(fd);
+        if ((it == _registrations.end()) || !it->second.armed || (!readable && !writable)) {
+            return;
+        }
+        it->second.armed = false;
+        OperationClass ready = (readable && writable) ? OperationClass::both : (readable ? OperationClass::read : OperationClass::write);
+        events.push_back({.token = it->second.token, .events = ready});
+    }
+
+public:
+    std::error_condition add(socket_t fd, OperationClass interest, uint64_t token) override
+    {
+        return update(fd, interest, token, false);
+    }
+
+    std::error_condition rearm(socket_t fd, OperationClass interest, uint64_t token) override
+    {
+        return update(fd, interest, token, true);
+    }
+
+    std::error_condition remove(socket_t fd) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _registrations.erase(fd);
+        return {};
+    }
+
+    void wakeup() override
+    {
+        _wakeup.notify();
+    }
+};
+
+class poll_reactor : public table_reactor {
+private:
+    std::vector<pollfd> _pollfds;
+
+public:
+    std::error_condition wait(std::vector<reactor_event> &events, std::chrono::milliseconds timeout) override
+    {
+        events.clear();
+        _pollfds.clear();
+        _pollfds.push_back({.fd = _wakeup.get_fd(), .events = POLLIN, .revents = 0});
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const auto &[fd, reg] : _registrations) {
+                if (!reg.armed) {
+                    continue;
+                }
+                short poll_events = 0;
+                if ((reg.interest == OperationClass::read) || (reg.interest == OperationClass::both)) {
+                    poll_events |= POLLIN;
+                }
+                if ((reg.interest == OperationClass::write) || (reg.interest == OperationClass::both)) {
+                    poll_events |= POLLOUT;
+                }
+                _pollfds.push_back({.fd = fd, .events = poll_events, .revents = 0});
+            }
+        }
+        int32_t timeout_ms = (timeout.count() < 0) ? -1 : static_cast<int32_t>(timeout.count());
+        int32_t poll_res = poll_syscall(_pollfds.data(), static_cast<uint32_t>(_pollfds.size()), timeout_ms);
+        if (poll_res < 0) {
+            std::error_condition wait_error = socket_get_last_error();
+            return (wait_error == std::errc::interrupted) ? std::error_condition{} : wait_error;
+        }
+        if (_pollfds.front().revents) {
+            _wakeup.drain();
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (std::size_t i = 1; i < _pollfds.size(); ++i) {
+            const pollfd &pfd = _pollfds[i];
+            bool failed = pfd.revents & (POLLERR | POLLHUP | POLLNVAL);
+            collect(pfd.fd, (pfd.revents & POLLIN) || failed, (pfd.revents & POLLOUT) || failed, events);
+        }
+        return {};
+    }
+
+    [[nodiscard]] ReactorBackend get_backend() const override
+    {
+        return ReactorBackend::poll;
+    }
+};
+
+class select_reactor : public table_reactor {
+public:
+    std::error_condition add(socket_t fd, OperationClass interest, uint64_t token) override
+    {
+#ifndef _WIN32
+        // fd_set is a bitmap on posix, descriptors beyond it can't be watched at all
+        if (fd >= FD_SETSIZE) {
+            return std::errc::too_many_files_open;
+        }
+#endif
+        return table_reactor::add(fd, interest, token);
+    }
+
+    std::error_condition wait(std::vector<reactor_event> &events, std::chrono::milliseconds timeout) override
+    {
+        events.clear();
+        fd_set read_set;
+        fd_set write_set;
+        FD_ZERO(&read_set);
+        FD_ZERO(&write_set);
+        socket_t highest_fd = _wakeup.get_fd();
+        FD_SET(highest_fd, &read_set);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const auto &[fd, reg] : _registrations) {
+                if (!reg.armed) {
+                    continue;
+                }
+                if ((reg.interest == OperationClass::read) || (reg.interest == OperationClass::both)) {
+                    FD_SET(fd, &read_set);
+                }
+                if ((reg.interest == OperationClass::write) || (reg.interest == OperationClass::both)) {
+                    FD_SET(fd, &write_set);
+                }
+                if (highest_fd < fd) {
+                    highest_fd = fd;
+                }
+            }
+        }
+        timeval tv{.tv_sec = static_cast<int32_t>(timeout.count() / 1000), .tv_usec = static_cast<int32_t>((timeout.count() % 1000) * 1000)};
+        int32_t select_res = ::select(highest_fd + 1, &read_set, &write_set, nullptr, (timeout.count() < 0) ? nullptr : &tv);
+        if (select_res < 0) {
+            std::error_condition wait_error = socket_get_last_error();
+            return (wait_error == std::errc::interrupted) ? std::error_condition{} : wait_error;
+        }
+        if (FD_ISSET(_wakeup.get_fd(), &read_set)) {
+            _wakeup.drain();
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto &[fd, reg] : _registrations) {
+            collect(fd, FD_ISSET(fd, &read_set), FD_ISSET(fd, &write_set), events);
+        }
+        return {};
+    }
+
+    [[nodiscard]] ReactorBackend get_backend() const override
+    {
+        return ReactorBackend::select;
+    }
+};
+
+inline std::pair<std::unique_ptr<reactor>, std::error_condition> reactor::create(ReactorBackend backend)
+{
+    std::unique_ptr<reactor> created;
+    switch (backend) {
+    case ReactorBackend::automatic:
+#ifdef NETLIB_HAS_EPOLL
+    case ReactorBackend::epoll:
+        created = std::make_unique<epoll_reactor>();
+        break;
+#else
+    case ReactorBackend::epoll:
+#endif
+    case ReactorBackend::poll:
+        created = std::make_unique<poll_reactor>();
+        break;
+    case ReactorBackend::select:
+        created = std::make_unique<select_reactor>();
+        break;
+    }
+    if (!created) {
+        return {nullptr, std::errc::invalid_argument};
+    }
+    if (std::error_condition init_error = created->_init_error) {
+        return {nullptr, init_error};
+    }
+    return {std::move(created), std::error_condition{}};
+}
+
+} // namespace netlib
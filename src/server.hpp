@@ -1,33 +1,56 @@
 #pragma once
 
+#include "buffer_pool.hpp"
+#include "connection_table.hpp"
+#include "cpu_affinity.hpp"
+#include "datagram_operations.hpp"
+#include "framer.hpp"
+#include "reactor.hpp"
 #include "service_resolver.hpp"
+#include "shared_buffer.hpp"
 #include "socket.hpp"
 #include "socket_operations.hpp"
 #include "thread_pool.hpp"
+#include "timer_wheel.hpp"
+#include <algorithm>
 #include <array>
 #include <atomic>
-#include <cassert>
+#include <deque>
 #include <functional>
 #include <iostream>
-#include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <span>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <variant>
 #include <vector>
 
 namespace netlib {
 
+// what happens to new connections once `server_config::max_connections` is reached
+enum class AdmissionPolicy {
+    // accept and close them right away, so clients fail fast
+    reject,
+    // leave them in the listen backlog until a connection closes, the kernel drops them once the backlog is full
+    delay
+};
+
 struct client_endpoint {
     netlib::socket socket;
     sockaddr addr{};
     socklen_t addr_len = sizeof(sockaddr);
+    // assigned by the server, unique per connection even if the socket descriptor gets reused
+    uint64_t id = 0;
 
     bool operator==(const client_endpoint &rhs) const
     {
-        // we only consider the socket to be relevant
-        return socket == rhs.socket;
+        // we only consider the connection to be relevant
+        return (socket == rhs.socket) && (id == rhs.id);
     }
     bool operator!=(const client_endpoint &rhs) const
     {
@@ -60,189 +83,1348 @@ struct client_endpoint {
 struct server_response {
     std::vector<uint8_t> answer{};
     bool terminate = false;
+    // queued after answer in this order, without copying. Can wrap pooled slabs or caller owned memory.
+    std::vector<shared_buffer_ptr> segments{};
+};
+
+struct server_config {
+    // readiness backend used by the processing thread, automatic picks epoll on linux and poll elsewhere
+    ReactorBackend reactor_backend = ReactorBackend::automatic;
+    // bind one listener per shard via SO_REUSEPORT and let the kernel balance connections between them
+    bool reuseport_sharding = false;
+    // amount of shards when sharding, 0 means one per hardware thread
+    std::size_t shard_count = 0;
+    // backlog passed to listen(), the kernel may cap it
+    int32_t accept_queue_size = SOMAXCONN;
+    // stop reading from a connection once this many bytes wait to be sent to it, 0 disables
+    std::size_t high_watermark = 0;
+    // resume reading from a paused connection once its pending bytes dropped to this amount
+    std::size_t low_watermark = 0;
+    // pending bytes of all connections together, beyond which every connection that is sent to stops reading. 0 disables
+    std::size_t memory_budget = 0;
+    // granularity of scheduled tasks and connection timeouts
+    std::chrono::milliseconds timer_resolution = std::chrono::milliseconds(10);
+    // close connections which neither sent nor received anything for this long, 0 disables
+    std::chrono::milliseconds idle_timeout = std::chrono::milliseconds(0);
+    // close connections which didn't send us anything for this long, 0 disables
+    std::chrono::milliseconds read_timeout = std::chrono::milliseconds(0);
+    // close connections whose pending data didn't make any progress for this long, 0 disables
+    std::chrono::milliseconds write_timeout = std::chrono::milliseconds(0);
+    // UDP only: datagrams received per syscall, and the largest datagram that is received without truncation
+    std::size_t datagram_batch_size = 64;
+    std::size_t max_datagram_size = 2048;
+    // UDP only: let the kernel coalesce datagrams of a flow (linux only). Needs room for 64k in max_datagram_size.
+    bool datagram_gro = false;
+    // UDP only: socket receive buffer size, which bounds bursts that can be absorbed. 0 keeps the system default.
+    std::size_t datagram_recv_buffer_size = 0;
+    // open connections of all shards together, 0 means unlimited
+    std::size_t max_connections = 0;
+    AdmissionPolicy admission_policy = AdmissionPolicy::reject;
+    // open connections per source address, 0 means unlimited
+    std::size_t max_connections_per_source = 0;
+    // callback tasks of this server queued or running in the thread pool, beyond which new connections are
+    // rejected and reads are postponed by a timer tick. 0 means unlimited.
+    std::size_t max_queued_tasks = 0;
+    // bytes a worker reads from one connection before handing it back, so busy connections can't starve
+    // others. Whatever is left gets picked up again right away. 0 reads until the socket is drained.
+    std::size_t read_budget = 256 * 1024;
+    // hold back answers until the worker is done with a connection, and send them with one syscall. Sends
+    // from other threads go out on the next write readiness. Flushed early once coalesce_bytes are queued.
+    bool coalesce_writes = false;
+    std::size_t coalesce_bytes = 64 * 1024;
+    // runs the callbacks, and may be shared with other servers and clients. Null gives the server a pool of
+    // its own. The server can't do without its tasks, so a bounded pool rejecting them is refused.
+    std::shared_ptr<netlib::thread_pool> executor;
+    // processing thread n runs on the n-th of these cpus. Pool workers are placed via thread_pool_config::affinity
+    affinity_config reactor_affinity;
+    // receive slabs each shard allocates up front from its processing thread, which puts them on that
+    // thread's NUMA node once it is pinned. Slabs allocated later land wherever the reading worker runs.
+    std::size_t prefill_buffers = 0;
+};
+
+struct connection_stats {
+    std::size_t bytes_received = 0;
+    std::size_t bytes_sent = 0;
+    std::size_t pending_bytes = 0;
+    // set while reading is paused because too much data is waiting to be sent
+    bool reading_paused = false;
+};
+
+struct shard_stats {
+    std::size_t accepted_connections = 0;
+    std::size_t active_connections = 0;
+    std::size_t processed_events = 0;
+    std::size_t receive_buffer_allocations = 0;
+    std::size_t received_datagrams = 0;
+    std::size_t sent_datagrams = 0;
+    // truncated datagrams, and replies the socket buffer had no room for
+    std::size_t dropped_datagrams = 0;
+    // closed right after accepting, because max_connections or max_queued_tasks was reached
+    std::size_t rejected_connections = 0;
+    // closed right after accepting, because their source address had too many connections
+    std::size_t rejected_by_source = 0;
+    // reads postponed because max_queued_tasks was reached
+    std::size_t deferred_reads = 0;
+    // readable connections handed to workers, and the pool tasks that carried them
+    std::size_t dispatched_events = 0;
+    std::size_t dispatch_tasks = 0;
 };
 
 using callback_connect_t = std::function<server_response(client_endpoint)>;
 using callback_recv_t = std::function<server_response(client_endpoint, std::vector<uint8_t>)>;
+// the buffer goes back to the receiving shard's pool once the callback drops it
+using callback_recv_buffer_t = std::function<server_response(client_endpoint, pooled_buffer)>;
+// the span points into a pooled slab and is only valid while the callback runs
+using callback_recv_span_t = std::function<server_response(client_endpoint, std::span<const uint8_t>)>;
 using callback_error_t = std::function<void(client_endpoint, std::error_condition)>;
+// UDP only: the span is only valid while the callback runs, the answer goes back to the sender
+using callback_datagram_t = std::function<server_response(const datagram_endpoint &, std::span<const uint8_t>)>;
+// called with true when reading from a connection gets paused, and with false when it resumes
+using callback_flow_control_t = std::function<void(client_endpoint, bool)>;
 
 class server {
 private:
-    std::optional<netlib::socket> _listener_sock;
-    int32_t _accept_queue_size = 10;
-    std::vector<client_endpoint> _clients;
-    std::map<client_endpoint, std::queue<std::vector<uint8_t>>> _out_queue;
-    std::mutex _mutex;
+    // upper bound for a single reactor wait, stop() wakes the reactor up anyway
+    static constexpr std::chrono::milliseconds REACTOR_WAIT_TIMEOUT = std::chrono::milliseconds(100);
+    // connections accepted per listener wakeup before other events get a turn again
+    static constexpr std::size_t ACCEPT_BATCH_SIZE = 128;
+    // shard index is encoded in 8 bits of a connection id
+    static constexpr std::size_t MAX_SHARDS = 256;
+    static constexpr uint64_t LISTENER_TOKEN = UINT64_MAX - 1;
+    // datagram batches received per wakeup before timers get a turn again
+    static constexpr std::size_t DATAGRAM_BATCHES_PER_WAKEUP = 16;
+    // queued buffers written by one syscall
+    static constexpr std::size_t MAX_GATHER = 64;
+
+    struct connection {
+        socket_t fd = INVALID_SOCKET;
+        // immutable after accept, the socket is closed through a copy
+        client_endpoint endpoint;
+        // data which could not be written without blocking, flushed on write readiness
+        std::deque<shared_buffer_ptr> out_queue;
+        std::size_t out_offset = 0;
+        connection_stats stats;
+        // partial frame left over from earlier reads, taken by the worker while it reads
+        frame_reader framing;
+        // activity as seen by the timeout checks
+        timer_wheel::clock::time_point last_receive;
+        timer_wheel::clock::time_point last_send;
+        // last time queued data was added to an empty queue or partially sent
+        timer_wheel::clock::time_point last_write_progress;
+        uint64_t timeout_timer = 0;
+        // key into the per source connection counts, empty if those aren't tracked
+        std::string source_key;
+        // set while the connect callback or a worker owns the connection. The registration is
+        // disarmed during that time, and only whoever clears this flag re-arms it.
+        bool dispatched = true;
+        bool terminate_after_flush = false;
+        // set when reading resumes, cleared once a worker reads again, see `has_held_back_frames`
+        bool resumed_with_frames = false;
+        // run by the worker owning the connection, after its callbacks, see `post`
+        std::deque<std::function<void()>> strand_tasks;
+    };
+    using connection_handle = connection_table<connection>::handle;
+
+    // receive and reply state of a UDP shard, reused for every batch so receiving doesn't allocate
+    struct datagram_batch {
+        std::vector<uint8_t> arena;
+        std::vector<datagram_recv_slot> recv_slots;
+        std::vector<datagram_endpoint> reply_destinations;
+        std::vector<server_response> replies;
+        std::vector<std::span<const uint8_t>> reply_parts;
+        std::vector<datagram_send_slot> send_slots;
+    };
+
+    // readable connections of one reactor wakeup, shared by the workers that drain it
+    struct ready_batch {
+        std::vector<client_endpoint> endpoints;
+        std::atomic<std::size_t> next = 0;
+    };
+
+    // every shard owns a listener, a reactor and the connections accepted on that listener.
+    // Shards never touch each other's state, so they don't contend on a common lock.
+    struct shard {
+        uint32_t index = 0;
+        netlib::socket listener;
+        connection_table<connection> connections;
+        std::shared_ptr<buffer_pool> buffers = buffer_pool::create();
+        std::unique_ptr<netlib::reactor> reactor;
+        // only runs on the processing thread, between reactor waits
+        std::unique_ptr<timer_wheel> timers;
+        std::thread processor_thread;
+        std::atomic<std::size_t> accepted_connections = 0;
+        std::atomic<std::size_t> processed_events = 0;
+        datagram_batch datagrams;
+        std::atomic<std::size_t> received_datagrams = 0;
+        std::atomic<std::size_t> sent_datagrams = 0;
+        std::atomic<std::size_t> dropped_datagrams = 0;
+        std::atomic<std::size_t> rejected_connections = 0;
+        std::atomic<std::size_t> rejected_by_source = 0;
+        std::atomic<std::size_t> deferred_reads = 0;
+        // set while the listener is left disarmed because max_connections was reached
+        std::atomic<bool> accept_paused = false;
+        // readable connections collected during one wakeup, only touched by the processing thread
+        std::vector<client_endpoint> ready;
+        std::atomic<std::size_t> dispatched_events = 0;
+        std::atomic<std::size_t> dispatch_tasks = 0;
+    };
+
+    int32_t _accept_queue_size = SOMAXCONN;
+    std::size_t _high_watermark = 0;
+    std::size_t _low_watermark = 0;
+    std::size_t _memory_budget = 0;
+    std::chrono::milliseconds _idle_timeout{0};
+    std::chrono::milliseconds _read_timeout{0};
+    std::chrono::milliseconds _write_timeout{0};
+    std::size_t _max_connections = 0;
+    AdmissionPolicy _admission_policy = AdmissionPolicy::reject;
+    std::size_t _max_connections_per_source = 0;
+    std::size_t _max_queued_tasks = 0;
+    std::size_t _read_budget = 0;
+    bool _coalesce_writes = false;
+    std::size_t _coalesce_bytes = 0;
+    // open connections of all shards, kept separately so admission doesn't have to lock every table
+    std::atomic<std::size_t> _connection_count = 0;
+    std::mutex _sources_mutex;
+    std::unordered_map<std::string, std::size_t> _source_connections;
+    // picks the shard that runs the next scheduled task
+    std::atomic<std::size_t> _next_timer_shard = 0;
+    // bytes queued on all connections of all shards
+    std::atomic<std::size_t> _pending_bytes = 0;
+    std::vector<std::unique_ptr<shard>> _shards;
     std::atomic<bool> _server_active = false;
     callback_connect_t _cb_onconnect{};
     callback_recv_t _cb_on_recv{};
+    callback_recv_buffer_t _cb_on_recv_buffer{};
+    callback_recv_span_t _cb_on_recv_span{};
     callback_error_t _cb_on_error{};
-    std::thread _accept_thread;
-    std::thread _processor_thread;
-    netlib::thread_pool _thread_pool; //= netlib::thread_pool::create<1,1>();
-    std::map<socket_t, std::atomic<bool>> _busy_map;
+    callback_flow_control_t _cb_on_flow_control{};
+    callback_datagram_t _cb_on_datagram{};
+    // set when bound to a datagram socket, the listener then receives instead of accepting
+    bool _datagram_mode = false;
+    std::shared_ptr<const framer> _framer;
+    std::shared_ptr<netlib::thread_pool> _thread_pool;
+    std::vector<std::size_t> _reactor_cpus;
+    std::size_t _prefill_buffers = 0;
+    // the pool may be shared, so shards are only torn down once all of their tasks are done
+    task_tracker _pool_tasks;
+
+    // connection ids double as reactor tokens: generation in the upper half, then shard and slot
+    static uint64_t to_id(const shard &sh, connection_handle handle)
+    {
+        return (static_cast<uint64_t>(handle.generation) << 32) | (static_cast<uint64_t>(sh.index) << 24) | handle.index;
+    }
+
+    static connection_handle to_handle(uint64_t id)
+    {
+        return {.index = static_cast<uint32_t>(id & 0xFFFFFF), .generation = static_cast<uint32_t>(id >> 32)};
+    }
+
+    inline shard *shard_of(uint64_t id)
+    {
+        std::size_t shard_index = (id >> 24) & 0xFF;
+        return ((id == 0) || (shard_index >= _shards.size())) ? nullptr : _shards[shard_index].get();
+    }
 
-    inline void processing_func()
+    inline void processing_func(shard &sh)
     {
+        std::vector<reactor_event> events;
         while (_server_active) {
-            fd_set fdset;
-            socket_t highest_fd = 0;
-            FD_ZERO(&fdset);
-            std::vector<client_endpoint> local_clients;
-            {
-                std::lock_guard<std::mutex> lock(_mutex);
-                local_clients = _clients;
-                for (auto &client : local_clients) {
-                    socket_t fd = client.socket.get_raw().value();
-                    assert(_busy_map.contains(fd));
-                    if (_busy_map[fd]) {
-                        // this fd is currently being handled by a task in threadpool
-                        continue;
+            // timers are checked at least once per tick while there are any
+            const std::chrono::milliseconds wait_timeout =
+                sh.timers->size() ? std::min(REACTOR_WAIT_TIMEOUT, sh.timers->get_resolution()) : REACTOR_WAIT_TIMEOUT;
+            std::error_condition wait_error = sh.reactor->wait(events, wait_timeout);
+            if (!wait_error) {
+                sh.processed_events += events.size();
+                for (const reactor_event &event : events) {
+                    if ((event.token == LISTENER_TOKEN) && _datagram_mode) {
+                        receive_datagrams(sh);
+                    } else if (event.token == LISTENER_TOKEN) {
+                        accept_connections(sh);
+                    } else {
+                        handle_event(sh, event.token, event.events);
                     }
-                    if (highest_fd < fd) {
-                        highest_fd = fd;
-                    }
-                    FD_SET(fd, &fdset);
                 }
+                dispatch_ready(sh);
             }
+            sh.timers->advance();
+        }
+    }
+
+    inline void handle_event(shard &sh, uint64_t id, OperationClass ready)
+    {
+        auto [lock, conn] = sh.connections.lock(to_handle(id));
+        if (!conn || conn->dispatched) {
+            // stale report, either the connection is gone or it was re-armed by a sender in the meantime
+            return;
+        }
+        std::optional<bool> flow_change;
+        if ((ready == OperationClass::write) || (ready == OperationClass::both)) {
+            std::error_condition flush_error = flush(*conn);
+            if (flush_error || (conn->terminate_after_flush && conn->out_queue.empty())) {
+                client_endpoint endpoint = conn->endpoint;
+                lock.unlock();
+                if (flush_error && _cb_on_error) {
+                    _cb_on_error(endpoint, flush_error);
+                }
+                remove_client(sh, id);
+                return;
+            }
+            flow_change = update_flow_control(*conn);
+        }
+        const bool held_back_frames = has_held_back_frames(*conn, flow_change);
+        if (((ready == OperationClass::read) || (ready == OperationClass::both) || held_back_frames) && !conn->terminate_after_flush &&
+            !conn->stats.reading_paused) {
+            if (is_overloaded()) {
+                // back off for a tick instead of growing the queue, the registration stays disarmed meanwhile
+                sh.deferred_reads++;
+                client_endpoint endpoint = conn->endpoint;
+                lock.unlock();
+                notify_flow_control(endpoint, flow_change);
+                sh.timers->schedule(sh.timers->get_resolution(), [this, &sh, id]() {
+                    retry_read(sh, id);
+                });
+                return;
+            }
+            conn->dispatched = true;
+            client_endpoint endpoint = conn->endpoint;
+            lock.unlock();
+            notify_flow_control(endpoint, flow_change);
+            // handed to the workers together with the other readable connections of this wakeup
+            sh.ready.push_back(std::move(endpoint));
+            return;
+        }
+        sh.reactor->rearm(conn->fd, interest(*conn), id);
+        if (flow_change) {
+            client_endpoint endpoint = conn->endpoint;
+            lock.unlock();
+            notify_flow_control(endpoint, flow_change);
+        }
+    }
+
+    // tasks are counted, so the shards they use outlive them even if the pool is shared. Posting can't fail,
+    // since `apply_config` refuses pools which reject tasks
+    template <typename FUNCTION> void run_in_pool(FUNCTION &&function, TaskPriority priority = TaskPriority::normal)
+    {
+        _thread_pool->post(priority, [token = _pool_tasks.acquire(), function = std::forward<FUNCTION>(function)]() mutable {
+            function();
+        });
+    }
+
+    /*!
+     * @brief Hands the readable connections of one wakeup to the workers. Instead of one pool task per
+     * connection, up to one task per worker is queued, and those pull connections off the shared batch
+     * until it is empty. A slow callback therefore only holds up its own worker.
+     */
+    inline void dispatch_ready(shard &sh)
+    {
+        if (sh.ready.empty()) {
+            return;
+        }
+        auto batch = std::make_shared<ready_batch>();
+        batch->endpoints.swap(sh.ready);
+        const std::size_t task_count = std::min(batch->endpoints.size(), std::max<std::size_t>(_thread_pool->get_max_thread_count(), 1));
+        sh.dispatched_events += batch->endpoints.size();
+        sh.dispatch_tasks += task_count;
+        for (std::size_t i = 0; i < task_count; ++i) {
+            run_in_pool([this, &sh, batch]() {
+                for (std::size_t next = batch->next++; next < batch->endpoints.size(); next = batch->next++) {
+                    this->run_strand(sh, batch->endpoints[next], true);
+                }
+            });
+        }
+    }
 
-            // windows returns WSAEINVAL if we have nothing to pass to select, so we
-            // need to filter this previously and elmulate the sleeping
-            if (!highest_fd) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    // drains the listener backlog, runs on the processing thread whenever the listener is readable
+    inline void accept_connections(shard &sh)
+    {
+        const socket_t listener_fd = sh.listener.get_raw().value();
+        for (std::size_t i = 0; i < ACCEPT_BATCH_SIZE; ++i) {
+            if (is_at_capacity() && (_admission_policy == AdmissionPolicy::delay)) {
+                sh.accept_paused = true;
+                // a connection may have closed before the flag was visible, in which case nobody re-arms
+                if (is_at_capacity() || !sh.accept_paused.exchange(false)) {
+                    return;
+                }
+            }
+            client_endpoint new_endpoint;
+            new_endpoint.addr_len = sizeof(new_endpoint.addr);
+#ifdef __linux__
+            socket_t status = ::accept4(listener_fd, &new_endpoint.addr, &new_endpoint.addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+            socket_t status = ::accept(listener_fd, &new_endpoint.addr, &new_endpoint.addr_len);
+#endif
+            if (status == INVALID_SOCKET) {
+                std::error_condition accept_error = socket_get_last_error();
+                if ((accept_error == std::errc::connection_aborted) || (accept_error == std::errc::interrupted)) {
+                    continue;
+                }
+                // backlog is empty, or we can't accept right now (i.e. out of descriptors)
+                break;
+            }
+            new_endpoint.socket.set_raw(status);
+#ifndef __linux__
+            new_endpoint.socket.set_nonblocking(true);
+#endif
+            if (is_at_capacity() || is_overloaded()) {
+                new_endpoint.socket.close();
+                sh.rejected_connections++;
                 continue;
             }
-            // we want the timeout to be fairly low, so that we avoid situations where
-            // we have a new client in _clients, but are not monitoring it yet - that
-            // would mean we have a "hardcoded" delay in servicing a new clients
-            // packets
-            timeval tv{.tv_sec = 0, .tv_usec = 5 * 1000}; // 5ms
-            int32_t select_res = ::select(highest_fd + 1, &fdset, nullptr, nullptr, &tv);
-            if (select_res > 0) {
-                std::vector<client_endpoint> client_refs(select_res);
-                int32_t index = 0;
-                {
-                    std::lock_guard<std::mutex> lock(_mutex);
-                    for (auto &client : local_clients) {
-                        socket_t fd = client.socket.get_raw().value();
-                        if (FD_ISSET(fd, &fdset)) {
-                            client_refs[index++] = client;
-                            assert(_busy_map.contains(fd));
-                            _busy_map[fd] = true;
-                        }
-                    }
+            std::string source_key;
+            if (_max_connections_per_source) {
+                source_key = source_key_of(status);
+                if (!admit_source(source_key)) {
+                    new_endpoint.socket.close();
+                    sh.rejected_by_source++;
+                    continue;
                 }
-                assert(index == select_res);
-                // add callback tasks to threadpool for processing
-                for (auto &client_to_recv : client_refs) {
-                    _thread_pool.add_task(
-                        [&](client_endpoint ce) {
-                            socket_t id = ce.socket.get_raw().value();
-                            std::error_condition error = this->handle_client(ce);
-                            if ((error) && (_cb_on_error)) {
-                                _cb_on_error(ce, error);
-                            }
-                            std::lock_guard<std::mutex> lock(_mutex);
-                            if (_busy_map.contains(id)) {
-                                _busy_map[id] = false;
-                            }
-                        },
-                        client_to_recv);
+            }
+            std::optional<connection_handle> handle = sh.connections.insert();
+            if (!handle) {
+                new_endpoint.socket.close();
+                release_source(source_key);
+                continue;
+            }
+            _connection_count++;
+            sh.accepted_connections++;
+            new_endpoint.id = to_id(sh, handle.value());
+            {
+                auto [lock, conn] = sh.connections.lock(handle.value());
+                conn->fd = status;
+                conn->endpoint = new_endpoint;
+                conn->framing = frame_reader(_framer);
+                conn->source_key = std::move(source_key);
+                conn->last_receive = conn->last_send = conn->last_write_progress = timer_wheel::clock::now();
+                if (std::optional<std::chrono::milliseconds> timeout = shortest_timeout()) {
+                    conn->timeout_timer = sh.timers->schedule(timeout.value(), [this, &sh, id = new_endpoint.id]() {
+                        check_timeouts(sh, id);
+                    });
                 }
-
-            } else if (select_res == 0) {
-                // nothing interesting happened before timeout
+            }
+            if (_cb_onconnect) {
+                // the connect callback and greeting may take a while, so they must not hold up accepting
+                // high priority, so new connections get greeted even while the workers are busy with bulk reads
+                run_in_pool(
+                    [this, &sh, new_endpoint]() {
+                        this->greet_client(sh, new_endpoint);
+                    },
+                    TaskPriority::high);
             } else {
-                // error was returned
+                register_client(sh, new_endpoint.id);
             }
         }
+        sh.reactor->rearm(listener_fd, OperationClass::read, LISTENER_TOKEN);
     }
 
-    inline void accept_func()
+    // drains the datagram socket in batches and sends the answers of each batch in one go
+    inline void receive_datagrams(shard &sh)
     {
-        client_endpoint new_endpoint;
-        while (_server_active) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            new_endpoint.addr_len = sizeof(addrinfo);
-            socket_t status = ::accept(_listener_sock->get_raw().value(), &new_endpoint.addr, &new_endpoint.addr_len);
-            if (status != INVALID_SOCKET) {
-                new_endpoint.socket.set_raw(status);
-                new_endpoint.socket.set_nonblocking(true);
-                if (_cb_onconnect) {
-                    netlib::server_response greeting = _cb_onconnect(new_endpoint);
-                    if (!greeting.answer.empty()) {
-                        std::error_condition send_error = send_to_endpoint(greeting.answer, new_endpoint);
-                        if (send_error && _cb_on_error) {
-                            _cb_on_error(new_endpoint, std::errc::connection_aborted);
+        datagram_batch &batch = sh.datagrams;
+        for (std::size_t round = 0; round < DATAGRAM_BATCHES_PER_WAKEUP; ++round) {
+            auto [received, recv_error] = datagram_operations::recv_batch(sh.listener, batch.recv_slots);
+            for (std::size_t i = 0; i < received; ++i) {
+                const datagram_recv_slot &slot = batch.recv_slots[i];
+                if (slot.truncated) {
+                    sh.dropped_datagrams++;
+                    continue;
+                }
+                // coalesced datagrams are handed out one by one, only the last one may be shorter
+                const std::size_t segment_size = slot.segment_size ? slot.segment_size : std::max<std::size_t>(slot.size, 1);
+                std::size_t offset = 0;
+                do {
+                    deliver_datagram(sh, slot.source, slot.buffer.subspan(offset, std::min(segment_size, slot.size - offset)));
+                    offset += segment_size;
+                } while (offset < slot.size);
+            }
+            send_datagram_replies(sh);
+            if (recv_error) {
+                // drained, or an error we can't do anything about, i.e. ICMP errors of earlier replies
+                break;
+            }
+        }
+        sh.reactor->rearm(sh.listener.get_raw().value(), OperationClass::read, LISTENER_TOKEN);
+    }
+
+    inline void deliver_datagram(shard &sh, const datagram_endpoint &source, std::span<const uint8_t> datagram)
+    {
+        sh.received_datagrams++;
+        if (!_cb_on_datagram) {
+            return;
+        }
+        server_response response = _cb_on_datagram(source, datagram);
+        if (!response.answer.empty() || !response.segments.empty()) {
+            sh.datagrams.reply_destinations.push_back(source);
+            sh.datagrams.replies.push_back(std::move(response));
+        }
+    }
+
+    inline void send_datagram_replies(shard &sh)
+    {
+        datagram_batch &batch = sh.datagrams;
+        if (batch.replies.empty()) {
+            return;
+        }
+        // all parts first, so the slots can refer to them without being invalidated by a reallocation
+        batch.reply_parts.clear();
+        for (const server_response &reply : batch.replies) {
+            if (!reply.answer.empty()) {
+                batch.reply_parts.emplace_back(reply.answer);
+            }
+            for (const shared_buffer_ptr &segment : reply.segments) {
+                if (segment && !segment->empty()) {
+                    batch.reply_parts.push_back(segment->get_span());
+                }
+            }
+        }
+        batch.send_slots.clear();
+        std::size_t part_index = 0;
+        for (std::size_t i = 0; i < batch.replies.size(); ++i) {
+            const server_response &reply = batch.replies[i];
+            std::size_t part_count = reply.answer.empty() ? 0 : 1;
+            for (const shared_buffer_ptr &segment : reply.segments) {
+                part_count += (segment && !segment->empty()) ? 1 : 0;
+            }
+            batch.send_slots.push_back({.destination = &batch.reply_destinations[i],
+                                        .parts = std::span<const std::span<const uint8_t>>(batch.reply_parts).subspan(part_index, part_count)});
+            part_index += part_count;
+        }
+        // datagrams may get lost anyway, so replies which don't fit right now are dropped instead of queued
+        auto [sent, send_error] = datagram_operations::send_batch(sh.listener, batch.send_slots);
+        sh.sent_datagrams += sent;
+        sh.dropped_datagrams += batch.send_slots.size() - sent;
+        for (std::size_t i = 0; i < batch.replies.size(); ++i) {
+            for (const shared_buffer_ptr &segment : batch.replies[i].segments) {
+                if (segment) {
+                    (i < sent) ? segment->mark_delivered() : segment->mark_dropped();
+                }
+            }
+        }
+        batch.replies.clear();
+        batch.reply_destinations.clear();
+    }
+
+    inline void greet_client(shard &sh, const client_endpoint &endpoint)
+    {
+        std::error_condition greeting_error = respond(sh, endpoint.id, _cb_onconnect(endpoint));
+        if (greeting_error && _cb_on_error) {
+            _cb_on_error(endpoint, greeting_error);
+        }
+        register_client(sh, endpoint.id);
+    }
+
+    // starts watching a client, which happens only after the connect callback ran
+    inline void register_client(shard &sh, uint64_t id)
+    {
+        auto [lock, conn] = sh.connections.lock(to_handle(id));
+        if (!conn) {
+            return;
+        }
+        // tasks posted during the connect callback keep the connection owned until they ran
+        const bool has_tasks = !conn->strand_tasks.empty();
+        conn->dispatched = has_tasks;
+        if (sh.reactor->add(conn->fd, interest(*conn), id)) {
+            lock.unlock();
+            remove_client(sh, id);
+            return;
+        }
+        if (has_tasks) {
+            client_endpoint endpoint = conn->endpoint;
+            lock.unlock();
+            run_in_pool([this, &sh, endpoint]() {
+                this->run_strand(sh, endpoint, false);
+            });
+        }
+    }
+
+    /*!
+     * @brief Worker side of a connection's strand. Reads up to the read budget if \p readable, then runs
+     * the tasks posted to the connection in order, and hands the connection back to the reactor once
+     * nothing is left. Whatever arrived in the meantime is reported right away, since registrations
+     * are level triggered. Frames held back by the framer aren't, so if the final flush resumes reading,
+     * the worker reads again first.
+     */
+    inline void run_strand(shard &sh, const client_endpoint &endpoint, bool readable)
+    {
+        while (true) {
+            if (std::exchange(readable, false)) {
+                std::error_condition error = handle_client(sh, endpoint);
+                // a drained socket is the normal way for reading to end
+                const bool drained = (error == std::errc::operation_would_block) || (error == std::errc::resource_unavailable_try_again);
+                if (error && !drained && _cb_on_error) {
+                    _cb_on_error(endpoint, error);
+                }
+            }
+            std::function<void()> task;
+            {
+                auto [lock, conn] = sh.connections.lock(to_handle(endpoint.id));
+                if (!conn) {
+                    return;
+                }
+                if (conn->strand_tasks.empty()) {
+                    // with write coalescing, everything the callbacks answered goes out together here
+                    std::error_condition flush_error = _coalesce_writes ? flush(*conn) : std::error_condition{};
+                    if (flush_error || (conn->terminate_after_flush && conn->out_queue.empty())) {
+                        lock.unlock();
+                        if (flush_error && _cb_on_error) {
+                            _cb_on_error(endpoint, flush_error);
                         }
+                        remove_client(sh, endpoint.id);
+                        return;
                     }
-                    if (greeting.terminate) {
-                        if (_cb_on_error) {
-                            _cb_on_error(new_endpoint, std::errc::connection_aborted);
-                        }
-                        remove_client(new_endpoint);
+                    std::optional<bool> flow_change = update_flow_control(*conn);
+                    if (has_held_back_frames(*conn, flow_change)) {
+                        // the flush resumed reading, the connection stays ours until those frames are handled
+                        lock.unlock();
+                        notify_flow_control(endpoint, flow_change);
+                        readable = true;
                         continue;
                     }
+                    conn->dispatched = false;
+                    sh.reactor->rearm(conn->fd, interest(*conn), endpoint.id);
+                    lock.unlock();
+                    notify_flow_control(endpoint, flow_change);
+                    return;
                 }
-                if (new_endpoint.socket.is_valid()) {
-                    std::lock_guard<std::mutex> lock(_mutex);
-                    _clients.push_back(new_endpoint);
-                    _busy_map[status] = false;
-                }
+                task = std::move(conn->strand_tasks.front());
+                conn->strand_tasks.pop_front();
             }
+            task();
+        }
+    }
+
+    // the shard index goes into the lowest 8 bits of the id, see `cancel_timer`
+    inline uint64_t schedule_timer(std::chrono::milliseconds delay, std::function<void()> task, std::chrono::milliseconds interval)
+    {
+        if (_shards.empty()) {
+            return 0;
         }
+        shard &sh = *_shards[_next_timer_shard++ % _shards.size()];
+        return (sh.timers->schedule(delay, std::move(task), interval) << 8) | sh.index;
     }
 
-    inline std::error_condition handle_client(client_endpoint endpoint)
+    inline std::error_condition handle_client(shard &sh, const client_endpoint &endpoint)
     {
+        if (_framer && !_cb_on_recv_buffer) {
+            return handle_client_framed(sh, endpoint);
+        }
+        if (_cb_on_recv_buffer || _cb_on_recv_span) {
+            return handle_client_pooled(sh, endpoint);
+        }
         //we already know that this socket has some data, so we dont timeout here
-        auto recv_result = netlib::operations::recv(endpoint.socket, 0);
-        if (!recv_result.first.empty() && _cb_on_recv) {
-            netlib::server_response response = _cb_on_recv(endpoint, recv_result.first);
-            if (!response.answer.empty()) {
-                std::error_condition send_error = send_to_endpoint(response.answer, endpoint);
-                if (send_error) {
-                    return send_error;
+        auto recv_result = netlib::operations::recv(endpoint.socket, _read_budget);
+        if (!recv_result.first.empty()) {
+            note_received(sh, endpoint.id, recv_result.first.size());
+            if (_cb_on_recv) {
+                std::error_condition response_error = respond(sh, endpoint.id, _cb_on_recv(endpoint, recv_result.first));
+                if (response_error) {
+                    return response_error;
                 }
             }
-            if (response.terminate) {
-                remove_client(endpoint);
-                return std::errc::connection_aborted;
-            }
         }
 
         if (recv_result.second == std::errc::connection_aborted) {
-            remove_client(endpoint);
+            remove_client(sh, endpoint.id);
             return std::errc::connection_aborted;
         }
 
         return recv_result.second;
     }
 
-    bool remove_client(client_endpoint &ce)
+    inline void note_received(shard &sh, uint64_t id, std::size_t byte_count)
+    {
+        auto [lock, conn] = sh.connections.lock(to_handle(id));
+        if (conn) {
+            conn->stats.bytes_received += byte_count;
+            if (_idle_timeout.count() || _read_timeout.count()) {
+                conn->last_receive = timer_wheel::clock::now();
+            }
+        }
+    }
+
+    std::optional<std::chrono::milliseconds> shortest_timeout() const
+    {
+        std::optional<std::chrono::milliseconds> shortest;
+        for (std::chrono::milliseconds timeout : {_idle_timeout, _read_timeout, _write_timeout}) {
+            if ((timeout.count() > 0) && (!shortest || (timeout < shortest.value()))) {
+                shortest = timeout;
+            }
+        }
+        return shortest;
+    }
+
+    /*!
+     * @brief Runs on the processing thread once the earliest timeout of a connection could have passed.
+     * Activity doesn't touch the timer, so if the connection was active in the meantime, the check is
+     * just scheduled again for the new deadline. This keeps the per byte cost down to a timestamp.
+     */
+    inline void check_timeouts(shard &sh, uint64_t id)
+    {
+        auto [lock, conn] = sh.connections.lock(to_handle(id));
+        if (!conn) {
+            return;
+        }
+        const timer_wheel::clock::time_point now = timer_wheel::clock::now();
+        std::optional<timer_wheel::clock::time_point> deadline;
+        auto consider = [&](std::chrono::milliseconds timeout, timer_wheel::clock::time_point since) {
+            if ((timeout.count() > 0) && (!deadline || (since + timeout < deadline.value()))) {
+                deadline = since + timeout;
+            }
+        };
+        consider(_idle_timeout, std::max(conn->last_receive, conn->last_send));
+        consider(_read_timeout, conn->last_receive);
+        if (!conn->out_queue.empty()) {
+            consider(_write_timeout, conn->last_write_progress);
+        }
+        if (!deadline) {
+            return;
+        }
+        if (deadline.value() > now) {
+            conn->timeout_timer = sh.timers->schedule(std::chrono::ceil<std::chrono::milliseconds>(deadline.value() - now), [this, &sh, id]() {
+                check_timeouts(sh, id);
+            });
+            return;
+        }
+        client_endpoint endpoint = conn->endpoint;
+        conn->timeout_timer = 0;
+        lock.unlock();
+        if (_cb_on_error) {
+            _cb_on_error(endpoint, std::errc::timed_out);
+        }
+        remove_client(sh, id);
+    }
+
+    // reads straight into slabs of the shard's buffer pool, one callback per filled slab
+    inline std::error_condition handle_client_pooled(shard &sh, const client_endpoint &endpoint)
+    {
+        std::size_t read_bytes = 0;
+        while (true) {
+            pooled_buffer buffer = sh.buffers->acquire();
+            auto recv_result = netlib::operations::recv(endpoint.socket, buffer.data(), buffer.capacity());
+            if (recv_result.first > 0) {
+                buffer.resize(recv_result.first);
+                note_received(sh, endpoint.id, recv_result.first);
+                std::error_condition response_error =
+                    respond(sh, endpoint.id,
+                            _cb_on_recv_buffer ? _cb_on_recv_buffer(endpoint, std::move(buffer)) : _cb_on_recv_span(endpoint, buffer.get_span()));
+                if (response_error) {
+                    return response_error;
+                }
+                if (is_reading_paused(sh, endpoint.id)) {
+                    // the rest stays in the socket until the peer took what we have for it
+                    return {};
+                }
+                read_bytes += recv_result.first;
+                if (_read_budget && (read_bytes >= _read_budget)) {
+                    // other connections get a turn, the rest is reported again right after re-arming
+                    return {};
+                }
+            }
+            if (recv_result.second == std::errc::connection_aborted) {
+                remove_client(sh, endpoint.id);
+                return std::errc::connection_aborted;
+            }
+            if (recv_result.second) {
+                return recv_result.second;
+            }
+        }
+    }
+
+    // reads into pooled slabs and hands complete frames to the span or vector callback
+    inline std::error_condition handle_client_framed(shard &sh, const client_endpoint &endpoint)
+    {
+        frame_reader reader;
+        {
+            auto [lock, conn] = sh.connections.lock(to_handle(endpoint.id));
+            if (!conn) {
+                return std::errc::not_connected;
+            }
+            // the connection may be removed by another thread while we read, so the reader is taken out
+            reader = conn->framing.has_framer() ? std::move(conn->framing) : frame_reader(_framer);
+            // held back frames are handed out first thing
+            conn->resumed_with_frames = false;
+        }
+        std::error_condition error = read_frames(sh, endpoint, reader);
+        auto [lock, conn] = sh.connections.lock(to_handle(endpoint.id));
+        if (conn) {
+            conn->framing = std::move(reader);
+        }
+        return error;
+    }
+
+    inline std::error_condition read_frames(shard &sh, const client_endpoint &endpoint, frame_reader &reader)
     {
-        // the remove_if-> erase idiom is perhaps my most hated part about std
-        // containers
-        std::lock_guard<std::mutex> lock(_mutex);
-        _busy_map.erase(ce.socket.get_raw().value());
-        std::erase_if(_clients, [&](const client_endpoint &single_endpoint) {
-            return (ce.socket.get_raw().value() == single_endpoint.socket.get_raw().value());
+        std::size_t read_bytes = 0;
+        bool paused = false;
+        std::error_condition response_error{};
+        auto on_frame = [&](std::span<const uint8_t> frame) -> std::error_condition {
+            if (_cb_on_recv_span) {
+                response_error = respond(sh, endpoint.id, _cb_on_recv_span(endpoint, frame));
+            } else if (_cb_on_recv) {
+                response_error = respond(sh, endpoint.id, _cb_on_recv(endpoint, std::vector<uint8_t>(frame.begin(), frame.end())));
+            }
+            if (response_error) {
+                return response_error;
+            }
+            // frames which are already buffered wait for the resume as well
+            paused = is_reading_paused(sh, endpoint.id);
+            return paused ? std::errc::operation_would_block : std::error_condition{};
+        };
+        // hands out frames which were held back while reading was paused
+        std::error_condition frame_error = reader.feed({}, on_frame);
+        while (true) {
+            if (response_error) {
+                return response_error;
+            }
+            if (paused) {
+                return {};
+            }
+            if (frame_error) {
+                // the stream can't be resynchronized after a framing error
+                remove_client(sh, endpoint.id);
+                return frame_error;
+            }
+            pooled_buffer buffer = sh.buffers->acquire();
+            auto recv_result = netlib::operations::recv(endpoint.socket, buffer.data(), buffer.capacity());
+            if (recv_result.first > 0) {
+                buffer.resize(recv_result.first);
+                note_received(sh, endpoint.id, recv_result.first);
+                frame_error = reader.feed(buffer.get_span(), on_frame);
+                if (response_error || paused || frame_error) {
+                    continue;
+                }
+                read_bytes += recv_result.first;
+                if (_read_budget && (read_bytes >= _read_budget)) {
+                    return {};
+                }
+            }
+            if (recv_result.second == std::errc::connection_aborted) {
+                remove_client(sh, endpoint.id);
+                return std::errc::connection_aborted;
+            }
+            if (recv_result.second) {
+                return recv_result.second;
+            }
+        }
+    }
+
+    inline std::error_condition respond(shard &sh, uint64_t id, server_response response)
+    {
+        if (!response.answer.empty()) {
+            response.segments.insert(response.segments.begin(), shared_buffer::create(std::move(response.answer)));
+        }
+        std::erase_if(response.segments, [](const shared_buffer_ptr &segment) {
+            return !segment || segment->empty();
         });
-        ce.socket.close();
+        if (!response.segments.empty()) {
+            // when coalescing, the worker flushes once it is done with the connection
+            std::error_condition send_error = enqueue(sh, id, response.segments, !_coalesce_writes);
+            if (send_error) {
+                return send_error;
+            }
+        }
+        if (response.terminate) {
+            auto [lock, conn] = sh.connections.lock(to_handle(id));
+            if (conn && conn->out_queue.empty()) {
+                lock.unlock();
+                remove_client(sh, id);
+            } else if (conn) {
+                // the answer is still on its way, close once it is flushed
+                conn->terminate_after_flush = true;
+            }
+            return std::errc::connection_aborted;
+        }
+        return {};
+    }
+
+    /*!
+     * @brief Queues data for a connection without ever blocking. With \p flush_now set and nothing queued
+     * yet, as much as possible is written right away. Everything else is flushed by the processing thread
+     * on write readiness. All \p buffers are queued under one lock, so other senders can't get in between.
+     */
+    inline std::error_condition enqueue(shard &sh, uint64_t id, std::span<const shared_buffer_ptr> buffers, bool flush_now)
+    {
+        auto [lock, conn] = sh.connections.lock(to_handle(id));
+        if (!conn) {
+            for (const shared_buffer_ptr &buffer : buffers) {
+                buffer->mark_dropped();
+            }
+            return std::errc::not_connected;
+        }
+        const bool was_idle = conn->out_queue.empty();
+        if (was_idle && _write_timeout.count()) {
+            conn->last_write_progress = timer_wheel::clock::now();
+        }
+        for (const shared_buffer_ptr &buffer : buffers) {
+            conn->stats.pending_bytes += buffer->size();
+            _pending_bytes += buffer->size();
+            conn->out_queue.push_back(buffer);
+        }
+        // if we weren't idle, we're already waiting for write readiness and appending keeps the order intact.
+        // Coalesced data is held back until the owner flushes, unless there's enough for full segments anyway.
+        if ((was_idle && flush_now) || (_coalesce_writes && (conn->stats.pending_bytes >= _coalesce_bytes))) {
+            std::error_condition flush_error = flush(*conn);
+            if (flush_error) {
+                lock.unlock();
+                remove_client(sh, id);
+                return flush_error;
+            }
+        }
+        std::optional<bool> flow_change = update_flow_control(*conn);
+        // a worker owning the connection handles them before handing it back, otherwise one is sent
+        const bool read_held_back = has_held_back_frames(*conn, flow_change) && !conn->dispatched;
+        if (read_held_back) {
+            conn->dispatched = true;
+        } else if ((was_idle || flow_change) && !conn->out_queue.empty() && !conn->dispatched) {
+            sh.reactor->rearm(conn->fd, interest(*conn), id);
+        }
+        if (flow_change || read_held_back) {
+            client_endpoint endpoint = conn->endpoint;
+            lock.unlock();
+            notify_flow_control(endpoint, flow_change);
+            if (read_held_back) {
+                run_in_pool([this, &sh, endpoint]() {
+                    this->run_strand(sh, endpoint, true);
+                });
+            }
+        }
+        return {};
+    }
+
+    /*!
+     * @brief Pauses reading from a connection once too much data waits to be sent to it, either on its
+     * own or on all connections together, and resumes once it drained. A paused connection always has
+     * data queued, so it is guaranteed to see write readiness and get resumed eventually.
+     *
+     * @return Returns the new state if it changed. Expects the connection to be locked.
+     */
+    inline std::optional<bool> update_flow_control(connection &conn)
+    {
+        if (!_high_watermark && !_memory_budget) {
+            return std::nullopt;
+        }
+        const std::size_t pending = conn.stats.pending_bytes;
+        if (!conn.stats.reading_paused) {
+            const bool over_watermark = _high_watermark && (pending > _high_watermark);
+            const bool over_budget = _memory_budget && (_pending_bytes > _memory_budget);
+            if ((pending > 0) && (over_watermark || over_budget)) {
+                conn.stats.reading_paused = true;
+                return true;
+            }
+        } else if ((pending == 0) || ((pending <= _low_watermark) && (!_memory_budget || (_pending_bytes <= _memory_budget)))) {
+            conn.stats.reading_paused = false;
+            return false;
+        }
+        return std::nullopt;
+    }
+
+    /*!
+     * @brief Frames the framer already buffered aren't reported by the reactor, so once reading resumes
+     * they need a read of their own, even if nothing new arrives. Remembers a resume in \p flow_change
+     * until a worker reads, since the reader is taken out of the connection while one does.
+     *
+     * @return Returns whether such frames wait and reading is allowed. Expects the connection to be locked.
+     */
+    inline bool has_held_back_frames(connection &conn, std::optional<bool> flow_change)
+    {
+        if (_framer && flow_change.has_value() && !flow_change.value()) {
+            conn.resumed_with_frames = true;
+        }
+        return conn.resumed_with_frames && !conn.stats.reading_paused && !conn.terminate_after_flush &&
+               (conn.framing.get_pending_size() > 0);
+    }
+
+    inline void notify_flow_control(const client_endpoint &endpoint, std::optional<bool> flow_change)
+    {
+        if (flow_change && _cb_on_flow_control) {
+            _cb_on_flow_control(endpoint, flow_change.value());
+        }
+    }
+
+    inline bool is_reading_paused(shard &sh, uint64_t id)
+    {
+        if (!_high_watermark && !_memory_budget) {
+            return false;
+        }
+        auto [lock, conn] = sh.connections.lock(to_handle(id));
+        return conn && conn->stats.reading_paused;
+    }
+
+    // hands the front of the queue to the kernel with a single syscall, gathering up to MAX_GATHER buffers
+    static std::pair<std::size_t, std::error_condition> write_queued(const connection &conn)
+    {
+#ifdef _WIN32
+        const shared_buffer &front = *conn.out_queue.front();
+        ssize_t send_res = ::send(conn.fd, reinterpret_cast<const char *>(front.data() + conn.out_offset),
+                                  static_cast<int32_t>(front.size() - conn.out_offset), MSG_NOSIGNAL);
+#else
+        std::array<iovec, MAX_GATHER> iovecs{};
+        std::size_t iovec_count = 0;
+        std::size_t offset = conn.out_offset;
+        for (const shared_buffer_ptr &buffer : conn.out_queue) {
+            if (iovec_count == MAX_GATHER) {
+                break;
+            }
+            iovecs[iovec_count++] = {.iov_base = const_cast<uint8_t *>(buffer->data() + offset), .iov_len = buffer->size() - offset};
+            offset = 0;
+        }
+        msghdr message{};
+        message.msg_iov = iovecs.data();
+        message.msg_iovlen = iovec_count;
+        ssize_t send_res = ::sendmsg(conn.fd, &message, MSG_NOSIGNAL);
+#endif
+        if (send_res < 0) {
+            return {0, socket_get_last_error()};
+        }
+        return {static_cast<std::size_t>(send_res), {}};
+    }
+
+    // writes queued data until the socket would block, expects the connection to be locked
+    inline std::error_condition flush(connection &conn)
+    {
+        while (!conn.out_queue.empty()) {
+            auto [written, send_error] = write_queued(conn);
+            if (send_error) {
+                if ((send_error == std::errc::resource_unavailable_try_again) || (send_error == std::errc::operation_would_block)) {
+                    return {};
+                }
+                if (send_error == std::errc::interrupted) {
+                    continue;
+                }
+                return send_error;
+            }
+            conn.stats.pending_bytes -= written;
+            _pending_bytes -= written;
+            conn.stats.bytes_sent += written;
+            if (_idle_timeout.count() || _write_timeout.count()) {
+                conn.last_send = conn.last_write_progress = timer_wheel::clock::now();
+            }
+            while (!conn.out_queue.empty()) {
+                const shared_buffer &front = *conn.out_queue.front();
+                const std::size_t taken = std::min(written, front.size() - conn.out_offset);
+                conn.out_offset += taken;
+                written -= taken;
+                if (conn.out_offset < front.size()) {
+                    break;
+                }
+                front.mark_delivered();
+                conn.out_queue.pop_front();
+                conn.out_offset = 0;
+            }
+        }
+        return {};
+    }
+
+    static OperationClass interest(const connection &conn)
+    {
+        if (conn.terminate_after_flush || conn.stats.reading_paused) {
+            return OperationClass::write;
+        }
+        return conn.out_queue.empty() ? OperationClass::read : OperationClass::both;
+    }
+
+    bool remove_client(shard &sh, uint64_t id)
+    {
+        // released after unlocking, since that may run broadcast completion callbacks
+        std::deque<shared_buffer_ptr> dropped;
+        auto [lock, conn] = sh.connections.lock(to_handle(id));
+        if (!conn) {
+            return false;
+        }
+        // deregister before closing, so a reused fd can't inherit the registration
+        sh.reactor->remove(conn->fd);
+        netlib::socket sock = conn->endpoint.socket;
+        sock.close();
+        for (const shared_buffer_ptr &buffer : conn->out_queue) {
+            buffer->mark_dropped();
+        }
+        dropped.swap(conn->out_queue);
+        _pending_bytes -= conn->stats.pending_bytes;
+        if (conn->timeout_timer) {
+            sh.timers->cancel(conn->timeout_timer);
+        }
+        release_source(conn->source_key);
+        sh.connections.erase(to_handle(id));
+        lock.unlock();
+        _connection_count--;
+        resume_accepting();
         return true;
     }
 
-    std::error_condition send_to_endpoint(const std::vector<uint8_t> &data, client_endpoint endpoint)
+    [[nodiscard]] bool is_at_capacity() const
     {
-        if (!endpoint.socket.is_valid()) {
-            return std::errc::not_a_socket;
+        return _max_connections && (_connection_count >= _max_connections);
+    }
+
+    [[nodiscard]] bool is_overloaded()
+    {
+        return _max_queued_tasks && (_pool_tasks.get_count() >= _max_queued_tasks);
+    }
+
+    // re-arms listeners which stopped accepting at the connection limit
+    inline void resume_accepting()
+    {
+        if (is_at_capacity()) {
+            return;
         }
+        for (auto &sh : _shards) {
+            // listeners are closed by stop while workers may still be removing connections
+            if (sh->accept_paused.exchange(false) && sh->listener.is_valid()) {
+                sh->reactor->rearm(sh->listener.get_raw().value(), OperationClass::read, LISTENER_TOKEN);
+            }
+        }
+    }
 
-        auto send_res = netlib::operations::send(endpoint.socket, data, std::chrono::milliseconds(1000));
-        if (send_res.first != data.size()) {
-            return std::errc::interrupted;
+    // runs on the processing thread once a postponed read waited for a tick
+    inline void retry_read(shard &sh, uint64_t id)
+    {
+        auto [lock, conn] = sh.connections.lock(to_handle(id));
+        if (conn && !conn->dispatched) {
+            if (has_held_back_frames(*conn, std::nullopt)) {
+                // the reactor wouldn't report those, so they go through the overload check right here
+                lock.unlock();
+                handle_event(sh, id, OperationClass::read);
+                dispatch_ready(sh);
+                return;
+            }
+            // still readable data is reported again, and goes through the overload check once more
+            sh.reactor->rearm(conn->fd, interest(*conn), id);
         }
-        return send_res.second;
+    }
+
+    // the peer address without its port, so every connection from one host counts against the same limit
+    static std::string source_key_of(socket_t fd)
+    {
+        sockaddr_storage peer{};
+        socklen_t peer_len = sizeof(peer);
+        if (::getpeername(fd, reinterpret_cast<sockaddr *>(&peer), &peer_len) != 0) {
+            return {};
+        }
+        if (peer.ss_family == AF_INET) {
+            const auto *ipv4 = reinterpret_cast<const sockaddr_in *>(&peer);
+            return {reinterpret_cast<const char *>(&ipv4->sin_addr), sizeof(ipv4->sin_addr)};
+        }
+        if (peer.ss_family == AF_INET6) {
+            const auto *ipv6 = reinterpret_cast<const sockaddr_in6 *>(&peer);
+            return {reinterpret_cast<const char *>(&ipv6->sin6_addr), sizeof(ipv6->sin6_addr)};
+        }
+        return {};
+    }
+
+    inline bool admit_source(const std::string &source_key)
+    {
+        if (source_key.empty()) {
+            // unknown peers aren't limited, there is nothing to tell them apart
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(_sources_mutex);
+        std::size_t &count = _source_connections[source_key];
+        if (count >= _max_connections_per_source) {
+            return false;
+        }
+        count++;
+        return true;
+    }
+
+    inline void release_source(const std::string &source_key)
+    {
+        if (source_key.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_sources_mutex);
+        auto it = _source_connections.find(source_key);
+        if ((it != _source_connections.end()) && (--it->second == 0)) {
+            _source_connections.erase(it);
+        }
+    }
+
+    std::error_condition create_listener(netlib::socket &listener, const addrinfo *res_addrinfo, const sockaddr *bind_addr,
+                                         socklen_t bind_addr_len, bool reuseport)
+    {
+        std::error_condition s_create_error = listener.create(res_addrinfo->ai_family, res_addrinfo->ai_socktype, res_addrinfo->ai_protocol);
+        if (s_create_error) {
+            return s_create_error;
+        }
+        listener.set_reuseaddr(true);
+        if (reuseport && !listener.set_reuseport(true)) {
+            std::error_condition reuseport_error = socket_get_last_error();
+            listener.close();
+            return reuseport_error ? reuseport_error : std::errc::not_supported;
+        }
+        listener.set_nonblocking(true); // we want to be able to join
+        int32_t res = ::bind(listener.get_raw().value(), bind_addr, bind_addr_len);
+        if ((res == 0) && (res_addrinfo->ai_socktype == SOCK_STREAM)) {
+            res = ::listen(listener.get_raw().value(), _accept_queue_size);
+        }
+        if (res < 0) {
+            std::error_condition bind_error = socket_get_last_error();
+            listener.close();
+            return bind_error;
+        }
+        return {};
+    }
+
+    // socket options take effect right away, before datagrams arrive that may otherwise be dropped
+    static void configure_datagram_listener(shard &sh, const server_config &config)
+    {
+        if (config.datagram_gro) {
+            datagram_operations::set_gro(sh.listener, true);
+        }
+        if (config.datagram_recv_buffer_size) {
+            sh.listener.set_recv_buffer_size(config.datagram_recv_buffer_size);
+        }
+    }
+
+    // runs on the processing thread of the shard, see start_shards
+    static void prepare_datagrams(shard &sh, const server_config &config)
+    {
+        const std::size_t batch_size = std::max<std::size_t>(config.datagram_batch_size, 1);
+        const std::size_t slot_size = std::max<std::size_t>(config.max_datagram_size, 1);
+        datagram_batch &batch = sh.datagrams;
+        batch.arena.resize(batch_size * slot_size);
+        batch.recv_slots.resize(batch_size);
+        for (std::size_t i = 0; i < batch_size; ++i) {
+            batch.recv_slots[i].buffer = std::span<uint8_t>(batch.arena).subspan(i * slot_size, slot_size);
+        }
+        batch.replies.reserve(batch_size);
+        batch.reply_destinations.reserve(batch_size);
+        batch.send_slots.reserve(batch_size);
+    }
+
+    std::error_condition create_shards(const addrinfo *res_addrinfo, std::size_t shard_count)
+    {
+        bool reuseport = shard_count > 1;
+        auto first_shard = std::make_unique<shard>();
+        std::error_condition listen_error = create_listener(first_shard->listener, res_addrinfo, res_addrinfo->ai_addr,
+                                                            static_cast<socklen_t>(res_addrinfo->ai_addrlen), reuseport);
+        if (listen_error == std::errc::not_supported) {
+            // no SO_REUSEPORT on this platform, fall back to a single shard
+            reuseport = false;
+            shard_count = 1;
+            listen_error = create_listener(first_shard->listener, res_addrinfo, res_addrinfo->ai_addr,
+                                           static_cast<socklen_t>(res_addrinfo->ai_addrlen), reuseport);
+        }
+        if (listen_error) {
+            return listen_error;
+        }
+        _shards.push_back(std::move(first_shard));
+
+        // the other shards bind to the address the first one actually got, which
+        // matters if the service was given as port 0
+        sockaddr_storage bound_addr{};
+        socklen_t bound_addr_len = sizeof(bound_addr);
+        ::getsockname(_shards.front()->listener.get_raw().value(), reinterpret_cast<sockaddr *>(&bound_addr), &bound_addr_len);
+        for (std::size_t i = 1; i < shard_count; ++i) {
+            auto new_shard = std::make_unique<shard>();
+            new_shard->index = static_cast<uint32_t>(i);
+            listen_error =
+                create_listener(new_shard->listener, res_addrinfo, reinterpret_cast<sockaddr *>(&bound_addr), bound_addr_len, reuseport);
+            if (listen_error) {
+                break;
+            }
+            _shards.push_back(std::move(new_shard));
+        }
+        if (listen_error) {
+            for (auto &sh : _shards) {
+                sh->listener.close();
+            }
+            _shards.clear();
+            return listen_error;
+        }
+        return {};
+    }
+
+    // sets up the reactors of the shards and starts processing, once all listeners exist
+    std::error_condition start_shards(const server_config &config)
+    {
+        for (auto &sh : _shards) {
+            auto [created_reactor, reactor_error] = netlib::reactor::create(config.reactor_backend);
+            if (reactor_error) {
+                // nothing runs yet, so the caller can just drop the shards
+                return reactor_error;
+            }
+            sh->reactor = std::move(created_reactor);
+            sh->timers = std::make_unique<timer_wheel>(config.timer_resolution);
+            if (_datagram_mode) {
+                configure_datagram_listener(*sh, config);
+            }
+            sh->reactor->add(sh->listener.get_raw().value(), OperationClass::read, LISTENER_TOKEN);
+        }
+        _server_active = true;
+        for (auto &sh : _shards) {
+            sh->processor_thread = std::thread([this, &current = *sh, config]() {
+                if (!_reactor_cpus.empty()) {
+                    cpu_affinity::pin_current_thread(_reactor_cpus[current.index % _reactor_cpus.size()]);
+                }
+                // memory goes to the NUMA node of the thread touching it first, so the shard's buffers
+                // are set up here. Nothing else uses them before the first wait.
+                if (_datagram_mode) {
+                    prepare_datagrams(current, config);
+                }
+                current.buffers->prefill(_prefill_buffers);
+                processing_func(current);
+            });
+        }
+        return {};
+    }
+
+    std::error_condition apply_config(const server_config &config)
+    {
+        // a dropped task would leave its connection dispatched, and so never watched again
+        if (config.executor && (config.executor->get_queue_capacity() > 0) &&
+            (config.executor->get_queue_full_policy() == QueueFullPolicy::reject)) {
+            return std::errc::invalid_argument;
+        }
+        _pool_tasks.wait();
+        _shards.clear();
+        _thread_pool = config.executor ? config.executor : std::make_shared<netlib::thread_pool>();
+        _pending_bytes = 0;
+        _connection_count = 0;
+        {
+            std::lock_guard<std::mutex> lock(_sources_mutex);
+            _source_connections.clear();
+        }
+        _accept_queue_size = config.accept_queue_size;
+        _high_watermark = config.high_watermark;
+        _low_watermark = std::min(config.low_watermark, config.high_watermark);
+        _memory_budget = config.memory_budget;
+        _idle_timeout = config.idle_timeout;
+        _read_timeout = config.read_timeout;
+        _write_timeout = config.write_timeout;
+        _max_connections = config.max_connections;
+        _admission_policy = config.admission_policy;
+        _max_connections_per_source = config.max_connections_per_source;
+        _max_queued_tasks = config.max_queued_tasks;
+        _read_budget = config.read_budget;
+        _coalesce_writes = config.coalesce_writes;
+        _coalesce_bytes = config.coalesce_bytes;
+        _prefill_buffers = config.prefill_buffers;
+        std::error_condition affinity_error;
+        std::tie(_reactor_cpus, affinity_error) = cpu_affinity::resolve(config.reactor_affinity);
+        return affinity_error;
+    }
+
+    // the socket type of an adopted listener, or an error if it can't serve as one
+    static std::pair<int32_t, std::error_condition> get_listener_type(socket_t fd)
+    {
+        int32_t socket_type = 0;
+        socklen_t option_len = sizeof(socket_type);
+        if (::getsockopt(fd, SOL_SOCKET, SO_TYPE, reinterpret_cast<char *>(&socket_type), &option_len) != 0) {
+            return {0, socket_get_last_error()};
+        }
+        if ((socket_type != SOCK_STREAM) && (socket_type != SOCK_DGRAM)) {
+            return {0, std::errc::invalid_argument};
+        }
+#ifdef SO_ACCEPTCONN
+        if (socket_type == SOCK_STREAM) {
+            int32_t listening = 0;
+            option_len = sizeof(listening);
+            if ((::getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, reinterpret_cast<char *>(&listening), &option_len) != 0) || !listening) {
+                return {0, std::errc::invalid_argument};
+            }
+        }
+#endif
+        return {socket_type, {}};
     }
 
 public:
@@ -253,12 +1435,14 @@ public:
     virtual ~server()
     {
         stop();
+        _pool_tasks.wait();
     }
     inline std::error_condition create(const std::string &bind_host, const std::variant<std::string, uint16_t> &service,
-                                       AddressFamily address_family, AddressProtocol address_protocol)
+                                       AddressFamily address_family, AddressProtocol address_protocol, server_config config = {})
     {
-        if (_listener_sock.has_value()) {
-            this->stop();
+        this->stop();
+        if (std::error_condition config_error = apply_config(config)) {
+            return config_error;
         }
 
         const std::string service_string =
@@ -270,43 +1454,106 @@ public:
             return addrinfo_result.second;
         }
 
-        auto close_and_free = [&]() {
-            this->stop();
-            freeaddrinfo(addrinfo_result.first);
-        };
+        std::size_t shard_count = 1;
+        if (config.reuseport_sharding) {
+            shard_count = config.shard_count ? config.shard_count : std::max<std::size_t>(1, std::thread::hardware_concurrency());
+            shard_count = std::min(shard_count, MAX_SHARDS);
+        }
 
+        std::error_condition create_error{};
         for (addrinfo *res_addrinfo = addrinfo_result.first; res_addrinfo != nullptr; res_addrinfo = res_addrinfo->ai_next) {
-            _listener_sock = netlib::socket();
-            std::error_condition s_create_error =
-                _listener_sock->create(res_addrinfo->ai_family, res_addrinfo->ai_socktype, res_addrinfo->ai_protocol);
-            if (s_create_error) {
-                close_and_free();
-                continue;
+            create_error = create_shards(res_addrinfo, shard_count);
+            if (!create_error) {
+                // all went well
+                break;
             }
-            _listener_sock->set_reuseaddr(true);
-            _listener_sock->set_nonblocking(true); // we want to be able to join
-            int32_t res = ::bind(_listener_sock->get_raw().value(), res_addrinfo->ai_addr, res_addrinfo->ai_addrlen);
-            if (res < 0) {
-                close_and_free();
-                continue;
+        }
+        freeaddrinfo(addrinfo_result.first);
+        if (create_error) {
+            return create_error;
+        }
+        _datagram_mode = (address_protocol == AddressProtocol::UDP);
+        if (std::error_condition start_error = start_shards(config)) {
+            for (auto &sh : _shards) {
+                sh->listener.close();
             }
-            if (address_protocol == AddressProtocol::TCP) {
-                res = ::listen(_listener_sock->get_raw().value(), _accept_queue_size);
-                if (res < 0) {
-                    close_and_free();
-                    continue;
-                }
+            _shards.clear();
+            return start_error;
+        }
+        return {};
+    }
+
+    /*!
+     * @brief Starts serving on sockets which are already bound, instead of creating new ones. They may be
+     * inherited from a parent process, or received from a predecessor via `listener_handoff`, so the listen
+     * backlog carries over and there is no moment in which connections are refused.
+     *
+     * @param listeners Listening TCP sockets or bound UDP sockets, all of the same type. Each one becomes a
+     * shard, so a set of `SO_REUSEPORT` listeners stays sharded. The server owns them once this succeeded.
+     *
+     * @return Returns \p invalid_argument if a socket is neither, or the types are mixed.
+     */
+    inline std::error_condition adopt(std::span<const socket_t> listeners, server_config config = {})
+    {
+        this->stop();
+        if (std::error_condition config_error = apply_config(config)) {
+            return config_error;
+        }
+        if (listeners.empty() || (listeners.size() > MAX_SHARDS)) {
+            return std::errc::invalid_argument;
+        }
+        std::optional<int32_t> common_type;
+        for (socket_t fd : listeners) {
+            auto [socket_type, type_error] = get_listener_type(fd);
+            if (type_error) {
+                return type_error;
             }
-            // all went well
-            break;
+            if (common_type && (common_type.value() != socket_type)) {
+                return std::errc::invalid_argument;
+            }
+            common_type = socket_type;
         }
-        if (_listener_sock) {
-            _server_active = true;
-            _accept_thread = std::thread(&server::accept_func, this);
-            _processor_thread = std::thread(&server::processing_func, this);
-            return {};
+        for (socket_t fd : listeners) {
+            auto new_shard = std::make_unique<shard>();
+            new_shard->index = static_cast<uint32_t>(_shards.size());
+            new_shard->listener.set_raw(fd);
+            new_shard->listener.set_nonblocking(true);
+            _shards.push_back(std::move(new_shard));
+        }
+        _datagram_mode = (common_type.value() == SOCK_DGRAM);
+        if (std::error_condition start_error = start_shards(config)) {
+            // the listeners stay the caller's
+            _shards.clear();
+            return start_error;
+        }
+        return {};
+    }
+
+    // the listening sockets of all shards, i.e. to pass them on via `listener_handoff`. They stay owned by the server.
+    [[nodiscard]] inline std::vector<socket_t> get_listeners() const
+    {
+        std::vector<socket_t> listeners;
+        listeners.reserve(_shards.size());
+        for (const auto &sh : _shards) {
+            if (sh->listener.is_valid()) {
+                listeners.push_back(sh->listener.get_raw().value());
+            }
+        }
+        return listeners;
+    }
+
+    /*!
+     * @brief Stops taking new connections or datagrams, while established connections are still served. Used
+     * once a successor adopted the listeners, so it gets everything that arrives from now on. A batch of
+     * accepts that is already running may still complete. The listeners stay open until `stop`.
+     */
+    inline void stop_accepting()
+    {
+        for (auto &sh : _shards) {
+            if (sh->listener.is_valid()) {
+                sh->reactor->remove(sh->listener.get_raw().value());
+            }
         }
-        return socket_get_last_error();
     }
     inline void register_callback_on_connect(callback_connect_t onconnect)
     {
@@ -316,21 +1563,151 @@ public:
     {
         _cb_on_recv = std::move(onrecv);
     };
+    /*!
+     * @brief Alternative to `register_callback_on_recv` which hands over pooled buffers instead of
+     * vectors, so receiving doesn't allocate in steady state. Takes precedence if both are registered.
+     */
+    inline void register_callback_on_recv_buffer(callback_recv_buffer_t onrecv)
+    {
+        _cb_on_recv_buffer = std::move(onrecv);
+    };
+    /*!
+     * @brief Like `register_callback_on_recv_buffer`, but the callback only gets to look at the data
+     * while it runs. Suits proxies and parsers which consume the bytes right away. Takes precedence
+     * over `register_callback_on_recv`.
+     */
+    inline void register_callback_on_recv_span(callback_recv_span_t onrecv)
+    {
+        _cb_on_recv_span = std::move(onrecv);
+    };
+    /*!
+     * @brief Makes the span and vector receive callbacks get one call per complete message, instead of
+     * whatever a single read returned. Partial messages are kept per connection until they are complete.
+     * Connections sending a malformed or oversized frame are closed. Callbacks registered via
+     * `register_callback_on_recv_buffer` still get raw slabs. Has to be set before `create`.
+     */
+    inline void set_framer(std::shared_ptr<const framer> message_framer)
+    {
+        _framer = std::move(message_framer);
+    }
+    /*!
+     * @brief UDP only, called once per received datagram on the processing thread of the receiving shard.
+     * Answers are collected per batch and sent with as few syscalls as possible.
+     */
+    inline void register_callback_on_datagram(callback_datagram_t ondatagram)
+    {
+        _cb_on_datagram = std::move(ondatagram);
+    };
     inline void register_callback_on_error(callback_error_t onerror)
     {
         _cb_on_error = std::move(onerror);
     };
+    /*!
+     * @brief Observes flow control, see `server_config::high_watermark` and `server_config::memory_budget`.
+     * Runs on whichever thread caused the change, so it should return quickly.
+     */
+    inline void register_callback_on_flow_control(callback_flow_control_t onflowcontrol)
+    {
+        _cb_on_flow_control = std::move(onflowcontrol);
+    };
 
+    /*!
+     * @brief Queues data for the given clients, or for all clients if \p endpoints is empty.
+     * Never blocks, the data is copied once and shared between all clients. See `broadcast`.
+     */
     inline std::error_condition send_data(const std::vector<uint8_t> &data, const std::vector<netlib::client_endpoint> &endpoints)
     {
-        std::lock_guard<std::mutex> lock(_mutex);
-        std::vector<client_endpoint> list = (endpoints.empty()) ? _clients : endpoints;
-        std::for_each(list.begin(), list.end(), [&](const netlib::client_endpoint &ce) {
-            //_out_queue[ce].push(data);
-            std::error_condition send_error = send_to_endpoint(data, ce);
+        return broadcast(shared_buffer::create(data), endpoints);
+    }
+
+    /*!
+     * @brief Queues a reference to \p buffer on every target client, without copying the payload.
+     *
+     * @param buffer The payload, see `shared_buffer::create`. Its completion callback runs once every
+     * target either received the whole payload or was disconnected before that.
+     *
+     * @param endpoints The target clients, or all currently connected clients if empty.
+     *
+     * @remark The processing threads of the shards flush the payload to their clients in parallel,
+     * the calling thread never writes to a socket.
+     */
+    inline std::error_condition broadcast(shared_buffer_ptr buffer, const std::vector<netlib::client_endpoint> &endpoints = {})
+    {
+        std::vector<std::pair<shard *, client_endpoint>> targets;
+        if (endpoints.empty()) {
+            for (auto &sh : _shards) {
+                sh->connections.for_each([&](connection_handle, const connection &conn) {
+                    targets.emplace_back(sh.get(), conn.endpoint);
+                });
+            }
+        }
+        for (const netlib::client_endpoint &ce : endpoints) {
+            targets.emplace_back(shard_of(ce.id), ce);
+        }
+        for (auto &[sh, ce] : targets) {
+            std::error_condition send_error = sh ? enqueue(*sh, ce.id, {&buffer, 1}, false) : std::errc::not_connected;
             if ((send_error) && (_cb_on_error)) {
                 _cb_on_error(ce, send_error);
             }
+        }
+        return {};
+    }
+
+    /*!
+     * @brief Runs \p task once after \p delay, on the processing thread of one of the shards. Tasks are
+     * spread over the shards. Tasks hold up event processing of their shard, so they should be short.
+     *
+     * @return Returns an id for `cancel_timer`, or 0 if the server wasn't created yet.
+     */
+    inline uint64_t schedule_after(std::chrono::milliseconds delay, std::function<void()> task)
+    {
+        return schedule_timer(delay, std::move(task), std::chrono::milliseconds(0));
+    }
+
+    // like `schedule_after`, but then runs \p task every \p interval until cancelled
+    inline uint64_t schedule_every(std::chrono::milliseconds interval, std::function<void()> task)
+    {
+        return schedule_timer(interval, std::move(task), interval);
+    }
+
+    // returns false if the task already ran or the id is unknown
+    inline bool cancel_timer(uint64_t timer_id)
+    {
+        const std::size_t shard_index = timer_id & 0xFF;
+        if ((timer_id == 0) || (shard_index >= _shards.size())) {
+            return false;
+        }
+        return _shards[shard_index]->timers->cancel(timer_id >> 8);
+    }
+
+    /*!
+     * @brief Runs \p task on the strand of a connection: after the receive callback that is running,
+     * if any, and never concurrently with other callbacks or tasks of that connection. Tasks run in
+     * the order they were posted, on a pool thread.
+     *
+     * @return Returns \p not_connected if the connection is gone, pending tasks are dropped when it closes.
+     */
+    inline std::error_condition post(const client_endpoint &endpoint, std::function<void()> task)
+    {
+        shard *sh = shard_of(endpoint.id);
+        if (!sh) {
+            return std::errc::not_connected;
+        }
+        {
+            auto [lock, conn] = sh->connections.lock(to_handle(endpoint.id));
+            if (!conn) {
+                return std::errc::not_connected;
+            }
+            conn->strand_tasks.push_back(std::move(task));
+            if (conn->dispatched) {
+                // the owner runs it before handing the connection back
+                return {};
+            }
+            // a readiness report that races with this is ignored, and repeated once the tasks ran
+            conn->dispatched = true;
+        }
+        run_in_pool([this, sh, endpoint]() {
+            this->run_strand(*sh, endpoint, false);
         });
         return {};
     }
@@ -338,22 +1715,69 @@ public:
     inline void stop()
     {
         _server_active = false;
-        if (_accept_thread.joinable()) {
-            _accept_thread.join();
+        for (auto &sh : _shards) {
+            sh->reactor->wakeup();
         }
-        if (_processor_thread.joinable()) {
-            _processor_thread.join();
-        }
-        if (_listener_sock.has_value()) {
-            _listener_sock->close();
-            _listener_sock.reset();
+        // shards stay alive until the next create, since pool tasks may still reference them
+        for (auto &sh : _shards) {
+            if (sh->processor_thread.joinable()) {
+                sh->processor_thread.join();
+            }
+            sh->listener.close();
         }
     }
 
     inline std::size_t get_client_count()
     {
-        std::lock_guard<std::mutex> lock(_mutex);
-        return _clients.size();
+        std::size_t client_count = 0;
+        for (auto &sh : _shards) {
+            client_count += sh->connections.size();
+        }
+        return client_count;
+    }
+
+    // bytes queued on all connections which could not be sent yet
+    inline std::size_t get_pending_bytes()
+    {
+        return _pending_bytes;
+    }
+
+    inline std::optional<connection_stats> get_connection_stats(const client_endpoint &endpoint)
+    {
+        shard *sh = shard_of(endpoint.id);
+        if (!sh) {
+            return std::nullopt;
+        }
+        auto [lock, conn] = sh->connections.lock(to_handle(endpoint.id));
+        if (!conn) {
+            return std::nullopt;
+        }
+        return conn->stats;
+    }
+
+    /*!
+     * @brief Returns one entry per shard. Without sharding, this is a single entry
+     * covering the whole server.
+     */
+    inline std::vector<shard_stats> get_shard_stats()
+    {
+        std::vector<shard_stats> stats;
+        stats.reserve(_shards.size());
+        for (auto &sh : _shards) {
+            stats.push_back({.accepted_connections = sh->accepted_connections,
+                             .active_connections = sh->connections.size(),
+                             .processed_events = sh->processed_events,
+                             .receive_buffer_allocations = sh->buffers->get_allocation_count(),
+                             .received_datagrams = sh->received_datagrams,
+                             .sent_datagrams = sh->sent_datagrams,
+                             .dropped_datagrams = sh->dropped_datagrams,
+                             .rejected_connections = sh->rejected_connections,
+                             .rejected_by_source = sh->rejected_by_source,
+                             .deferred_reads = sh->deferred_reads,
+                             .dispatched_events = sh->dispatched_events,
+                             .dispatch_tasks = sh->dispatch_tasks});
+        }
+        return stats;
     }
 };
 } // namespace netlib
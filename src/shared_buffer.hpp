@@ -0,0 +1,115 @@
+#pragma once
+
+#include "buffer_pool.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace netlib {
+
+using callback_broadcast_t = std::function<void(std::size_t delivered, std::size_t dropped)>;
+
+/*!
+ * @brief Immutable, reference counted payload which can be queued on any number
+ * of connections without being copied.
+ *
+ * Every connection holding a reference marks it as either delivered (fully
+ * written to the socket) or dropped (connection closed before that). Once the
+ * last reference is gone, the completion callback is invoked with both counts,
+ * on whichever thread released that reference.
+ *
+ * The payload is either owned (a vector or a pooled slab), or caller owned memory
+ * referenced via `shared_buffer::reference`.
+ */
+class shared_buffer {
+private:
+    std::vector<uint8_t> _data;
+    pooled_buffer _pooled;
+    std::span<const uint8_t> _view;
+    callback_broadcast_t _on_complete;
+    mutable std::atomic<std::size_t> _delivered = 0;
+    mutable std::atomic<std::size_t> _dropped = 0;
+
+public:
+    explicit shared_buffer(std::vector<uint8_t> data, callback_broadcast_t on_complete = {})
+        : _data(std::move(data)), _view(_data), _on_complete(std::move(on_complete))
+    {
+    }
+
+    explicit shared_buffer(pooled_buffer data, callback_broadcast_t on_complete = {})
+        : _pooled(std::move(data)), _view(_pooled.get_span()), _on_complete(std::move(on_complete))
+    {
+    }
+
+    explicit shared_buffer(std::span<const uint8_t> view, callback_broadcast_t on_complete = {})
+        : _view(view), _on_complete(std::move(on_complete))
+    {
+    }
+
+    ~shared_buffer()
+    {
+        if (_on_complete) {
+            _on_complete(_delivered, _dropped);
+        }
+    }
+
+    shared_buffer(const shared_buffer &) = delete;
+    shared_buffer &operator=(const shared_buffer &) = delete;
+
+    static std::shared_ptr<const shared_buffer> create(std::vector<uint8_t> data, callback_broadcast_t on_complete = {})
+    {
+        return std::make_shared<const shared_buffer>(std::move(data), std::move(on_complete));
+    }
+
+    // takes over a received slab, which goes back to its pool once the payload is done
+    static std::shared_ptr<const shared_buffer> create(pooled_buffer data, callback_broadcast_t on_complete = {})
+    {
+        return std::make_shared<const shared_buffer>(std::move(data), std::move(on_complete));
+    }
+
+    /*!
+     * @brief Refers to caller owned memory without copying it. The memory has to stay valid
+     * and unchanged until \p on_complete ran, or until the last reference is dropped.
+     */
+    static std::shared_ptr<const shared_buffer> reference(std::span<const uint8_t> view, callback_broadcast_t on_complete = {})
+    {
+        return std::make_shared<const shared_buffer>(view, std::move(on_complete));
+    }
+
+    [[nodiscard]] const uint8_t *data() const
+    {
+        return _view.data();
+    }
+
+    [[nodiscard]] std::size_t size() const
+    {
+        return _view.size();
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return _view.empty();
+    }
+
+    [[nodiscard]] std::span<const uint8_t> get_span() const
+    {
+        return _view;
+    }
+
+    void mark_delivered() const
+    {
+        _delivered++;
+    }
+
+    void mark_dropped() const
+    {
+        _dropped++;
+    }
+};
+
+using shared_buffer_ptr = std::shared_ptr<const shared_buffer>;
+
+} // namespace netlib
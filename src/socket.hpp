@@ -174,6 +174,17 @@ public:
 #endif
     }
 
+    bool set_reuseport(bool reuseport = true)
+    {
+#ifdef SO_REUSEPORT
+        auto mode = static_cast<int32_t>(reuseport);
+        return setsockopt(_socket.value(), SOL_SOCKET, SO_REUSEPORT, &mode, sizeof(int32_t)) == 0;
+#else
+        // windows has no equivalent which distributes connections between sockets
+        return false;
+#endif
+    }
+
     std::error_condition create(int32_t domain, int32_t stype, int32_t protocol)
     {
         initialize_system();
@@ -182,7 +193,8 @@ public:
             return socket_get_last_error();
         }
         _socket = new_socket;
-        if (!set_nagle(false)) {
+        // TCP_NODELAY only exists for stream sockets, datagram sockets would fail here
+        if ((stype == SOCK_STREAM) && !set_nagle(false)) {
             return socket_get_last_error();
         }
         return {};
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "socket.hpp"
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <iostream>
+#include <span>
 #include <thread>
 #include <vector>
 
@@ -14,7 +16,7 @@ private:
 
 public:
 
-    static inline std::pair<std::size_t, std::error_condition> send(const netlib::socket &sock, const std::vector<uint8_t> &data,
+    static inline std::pair<std::size_t, std::error_condition> send(const netlib::socket &sock, std::span<const uint8_t> data,
                                                                     std::chrono::milliseconds timeout)
     {
         std::size_t total_sent_size = 0;
@@ -47,33 +49,53 @@ public:
         }
     }
 
-    static inline std::pair<std::vector<uint8_t>, std::error_condition> recv(const netlib::socket &sock, std::size_t byte_count)
+    /*!
+     * @brief Reads straight into caller owned memory, without allocating.
+     *
+     * @return Returns the amount of bytes read and an error. The error is empty if \p capacity
+     * bytes were read, \p operation_would_block if all pending data was read before that, and
+     * \p connection_aborted if the peer closed the connection.
+     */
+    static inline std::pair<std::size_t, std::error_condition> recv(const netlib::socket &sock, uint8_t *buffer, std::size_t capacity)
     {
-        const std::size_t read_chunk_size =
-            (byte_count == 0) ? MAX_CHUNK_SIZE : (byte_count > MAX_CHUNK_SIZE ? MAX_CHUNK_SIZE : byte_count);
         std::size_t total_recv_size = 0;
-        std::vector<uint8_t> data;
-        std::array<uint8_t, MAX_CHUNK_SIZE> temp_recv_buffer{};
-        while (true) {
-            ssize_t recv_res = ::recv(sock.get_raw().value(), reinterpret_cast<char *>(temp_recv_buffer.data()), read_chunk_size, 0);
+        while (total_recv_size < capacity) {
+            ssize_t recv_res = ::recv(sock.get_raw().value(), reinterpret_cast<char *>(buffer + total_recv_size),
+                                      static_cast<int32_t>(capacity - total_recv_size), 0);
             if (recv_res > 0) {
-                data.insert(data.end(), temp_recv_buffer.begin(), temp_recv_buffer.begin() + recv_res);
-                total_recv_size += recv_res;
-                if (total_recv_size == byte_count) {
-                    data.resize(total_recv_size);
-                    // we got exactly the amount of data that user wanted/expected
-                    return {data, {}};
-                }
+                total_recv_size += static_cast<std::size_t>(recv_res);
             } else if (recv_res == 0) {
-                data.resize(total_recv_size);
-                return {data, std::errc::connection_aborted};
-            } else if (recv_res < 0) {
+                return {total_recv_size, std::errc::connection_aborted};
+            } else {
                 std::error_condition recv_error = socket_get_last_error();
                 if ((recv_error == std::errc::resource_unavailable_try_again) || (recv_error == std::errc::operation_would_block)) {
                     // we got all pending data
-                    data.resize(total_recv_size);
-                    return {data, std::errc::operation_would_block};
+                    return {total_recv_size, std::errc::operation_would_block};
                 }
+                if (recv_error != std::errc::interrupted) {
+                    return {total_recv_size, recv_error};
+                }
+            }
+        }
+        return {total_recv_size, {}};
+    }
+
+    static inline std::pair<std::vector<uint8_t>, std::error_condition> recv(const netlib::socket &sock, std::size_t byte_count)
+    {
+        std::vector<uint8_t> data;
+        while (true) {
+            // read directly into the tail of the result, instead of going through a temporary buffer
+            const std::size_t total_recv_size = data.size();
+            const std::size_t read_chunk_size = (byte_count == 0) ? MAX_CHUNK_SIZE : std::min(MAX_CHUNK_SIZE, byte_count - total_recv_size);
+            data.resize(total_recv_size + read_chunk_size);
+            auto recv_result = recv(sock, data.data() + total_recv_size, read_chunk_size);
+            data.resize(total_recv_size + recv_result.first);
+            if (recv_result.second) {
+                return {std::move(data), recv_result.second};
+            }
+            if (data.size() == byte_count) {
+                // we got exactly the amount of data that user wanted/expected
+                return {std::move(data), {}};
             }
         }
     }
@@ -81,31 +103,31 @@ public:
     static inline std::pair<std::vector<uint8_t>, std::error_condition> recv(const netlib::socket &sock, std::size_t byte_count,
                                                                              std::chrono::milliseconds timeout)
     {
-
-        // if user wants all data, we use max chunk size. Also, if he wants more
-        // than chunk size, we limit it too.
-        const std::size_t read_chunk_size =
-            (byte_count == 0) ? MAX_CHUNK_SIZE : (byte_count > MAX_CHUNK_SIZE ? MAX_CHUNK_SIZE : byte_count);
         std::vector<uint8_t> data;
         while (true) {
             auto wait_res = wait_for_operation(sock.get_raw().value(), OperationClass::read, timeout);
             if (wait_res.first) {
-                return {data, wait_res.first}; // return the data we have
+                return {std::move(data), wait_res.first}; // return the data we have
             }
             timeout -= wait_res.second;
-            auto recv_result = recv(sock, read_chunk_size);
-            data.insert(data.end(), recv_result.first.begin(), recv_result.first.end());
+            // if user wants all data, we use max chunk size. Also, if he wants more
+            // than chunk size, we limit it too.
+            const std::size_t total_recv_size = data.size();
+            const std::size_t read_chunk_size = (byte_count == 0) ? MAX_CHUNK_SIZE : std::min(MAX_CHUNK_SIZE, byte_count - total_recv_size);
+            data.resize(total_recv_size + read_chunk_size);
+            auto recv_result = recv(sock, data.data() + total_recv_size, read_chunk_size);
+            data.resize(total_recv_size + recv_result.first);
             if (data.size() == byte_count) {
                 // we got exactly the amount of data that user wanted/expected
-                return {data, {}};
+                return {std::move(data), {}};
             }
             if (timeout.count() <= 0) {
                 // we timed out
-                return {data, std::errc::timed_out}; // timeout error
+                return {std::move(data), std::errc::timed_out}; // timeout error
             }
 
             if (recv_result.second && recv_result.second == std::errc::connection_aborted) {
-                return {data, std::errc::connection_aborted};
+                return {std::move(data), std::errc::connection_aborted};
             }
         }
     }
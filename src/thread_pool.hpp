@@ -1,68 +1,563 @@
 #pragma once
 
+#include "block_pool.hpp"
+#include "cpu_affinity.hpp"
+#include "mpmc_queue.hpp"
+#include "unique_task.hpp"
+#include "work_stealing_deque.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 #include <future>
-#include <queue>
+#include <memory>
+#include <mutex>
+#include <system_error>
 #include <thread>
+#include <type_traits>
 #include <vector>
 namespace netlib {
+
+enum class PoolScheduling {
+    // every task goes through one queue shared by all workers
+    shared_queue,
+    // tasks submitted by a worker go to its own deque, and idle workers steal from the others.
+    // Tasks from other threads go through the shared queue.
+    work_stealing
+};
+
+// what happens to a task submitted while a bounded shared queue is full
+enum class QueueFullPolicy {
+    // the submitter waits for a free slot. A worker submitting to its own pool runs the task instead,
+    // since all workers waiting on each other would never free one
+    block,
+    // the task is dropped, post reports an error and the future of add_task a broken promise
+    reject,
+    // the submitter runs the task itself, which slows down whoever produces too many
+    run_inline
+};
+
+// lanes of the shared queue, workers look at them in this order
+enum class TaskPriority {
+    // control plane work like accepting and greeting connections, ahead of everything else
+    high,
+    normal,
+    // bulk work which may wait, like large transfers
+    low
+};
+
+struct thread_pool_config {
+    std::size_t start_threads = 1;
+    // threads kept even if idle for longer than keep_alive
+    std::size_t min_threads = 1;
+    // 0 means one per hardware thread
+    std::size_t max_threads = 0;
+    // a worker which found nothing to do for this long exits, unless only min_threads are left. 0 keeps them forever
+    std::chrono::milliseconds keep_alive = std::chrono::seconds(30);
+    // another thread is started once a task waited this long for a worker, or nothing was picked up for this long.
+    // A watchdog thread, started the first time every worker is busy, checks this even if no worker gets to the task
+    std::chrono::microseconds max_queue_delay = std::chrono::milliseconds(1);
+    PoolScheduling scheduling = PoolScheduling::work_stealing;
+    // times an idle worker looks for tasks again before going to sleep
+    std::size_t spin_rounds = 64;
+    // 0 means an unbounded shared queue behind a mutex, otherwise a lock-free ring of this many tasks
+    std::size_t queue_capacity = 0;
+    QueueFullPolicy queue_full_policy = QueueFullPolicy::block;
+    // every n-th task a worker picks comes from the lowest non-empty lane, so a flood of high
+    // priority tasks can't starve the others. 0 serves the lanes strictly in order
+    std::size_t starvation_interval = 16;
+    // worker n runs on the n-th of these cpus, wrapping around. Left unpinned if they can't be resolved
+    affinity_config affinity;
+};
+
 class thread_pool {
 private:
-    std::vector<std::thread> _thread_pool;
+    struct queued_task {
+        unique_task task;
+        // steady clock nanoseconds when queued. 0 if a worker was idle back then, so there's no latency to watch
+        int64_t enqueued_at = 0;
+    };
+
+    // queued tasks live in nodes which are recycled, so queueing a task doesn't allocate
+    struct task_node : queued_task {
+        task_node *next = nullptr;
+    };
+
+    // free nodes a worker keeps for itself, beyond that they go back to the shared list
+    static constexpr std::size_t LOCAL_CACHED_NODES = 64;
+    static constexpr std::size_t MAX_CACHED_NODES = 4096;
+    // limits of the default pool, whose tasks block on sockets rather than keep a cpu busy
+    static constexpr std::size_t DEFAULT_POOL_THREADS_PER_CPU = 8;
+    static constexpr std::size_t DEFAULT_POOL_MIN_MAX_THREADS = 64;
+
+    struct worker {
+        std::thread thread;
+        work_stealing_deque<task_node> tasks;
+        // owner only
+        task_node *free_nodes = nullptr;
+        std::size_t free_count = 0;
+        // guarded by _size_mutex, a retired worker's slot is reused by the next thread started
+        bool running = false;
+        // owner only, tasks picked since the lower lanes last went first
+        std::size_t picked_in_order = 0;
+    };
+
+    static constexpr std::size_t LANE_COUNT = 3;
+
+    // one per priority. Normal priority tasks of workers skip the lanes and go to their own deque
+    struct lane {
+        // guarded by _mutex
+        task_node *head = nullptr;
+        task_node *tail = nullptr;
+        // replaces the list if the shared queue is bounded
+        std::unique_ptr<mpmc_queue<queued_task>> bounded;
+        std::atomic<std::size_t> count = 0;
+    };
+
+    // lets submissions from a worker go to its own deque
+    static inline thread_local const thread_pool *tls_pool = nullptr;
+    static inline thread_local worker *tls_worker = nullptr;
+
+    thread_pool_config _config;
+    // one slot per possible thread, allocated up front so thieves never race with growth
+    std::vector<std::unique_ptr<worker>> _workers;
+    // slots which ever had a thread, thieves only look at these
+    std::atomic<std::size_t> _slot_count = 0;
+    std::atomic<std::size_t> _thread_count = 0;
+    // workers which aren't running a task
+    std::atomic<std::size_t> _idle = 0;
+    // when a worker last picked up a task with a latency to watch
+    std::atomic<int64_t> _last_pickup = 0;
+    int64_t _max_queue_delay;
+    std::size_t _min_threads;
+    std::vector<std::size_t> _cpus;
+    // only ever held briefly, guards starting and retiring threads
+    std::mutex _size_mutex;
+    // started on first use, starts a worker for tasks stuck behind busy ones
+    std::thread _watchdog;
+    std::condition_variable _cv_watchdog;
+    // set by a submitter finding every worker busy, cleared by the watchdog once it had a look
+    std::atomic<bool> _watchdog_armed = false;
     std::condition_variable _cv_new_job;
+    std::condition_variable _cv_free_slot;
+    // guards the lanes, the shared free nodes, and the sleeping workers and submitters
     std::mutex _mutex;
-    std::queue<std::function<void()>> _task_queue;
+    std::array<lane, LANE_COUNT> _lanes;
+    std::atomic<std::size_t> _blocked_submitters = 0;
+    task_node *_free_nodes = nullptr;
+    std::size_t _free_count = 0;
+    // tasks in all queues together, so neither sleeping nor counting has to look into every queue
+    std::atomic<std::size_t> _queued = 0;
+    std::atomic<std::size_t> _sleeping = 0;
     std::atomic<bool> _active = false;
-    std::size_t _max_threads = 1;
-    void add_thread()
-    {
-        auto thread_worker_fun = [this]() {
-            while (_active) {
-                std::function<void()> task;
-                {
-                    std::unique_lock<std::mutex> lock(_mutex);
-                    _cv_new_job.wait(lock, [this] {
-                        // we wait either until there is at least one task
-                        // in the queue, or until we shutdown this thing
-                        return (!_task_queue.empty()) || (!_active);
-                    });
-
-                    if (!_active) {
-                        break; // terminate thread
+    // backs the shared state of the futures add_task returns
+    std::shared_ptr<block_pool> _state_pool = block_pool::create();
+
+    static void delete_nodes(task_node *nodes)
+    {
+        while (nodes) {
+            delete std::exchange(nodes, nodes->next);
+        }
+    }
+
+    // requires _mutex
+    task_node *acquire_shared_node()
+    {
+        if (!_free_nodes) {
+            return new task_node;
+        }
+        _free_count--;
+        return std::exchange(_free_nodes, _free_nodes->next);
+    }
+
+    task_node *acquire_local_node(worker &self)
+    {
+        if (!self.free_nodes) {
+            // refill with up to half a cache in one go, instead of locking for every node
+            std::lock_guard<std::mutex> lock(_mutex);
+            while (_free_nodes && (self.free_count < LOCAL_CACHED_NODES / 2)) {
+                task_node *node = std::exchange(_free_nodes, _free_nodes->next);
+                node->next = std::exchange(self.free_nodes, node);
+                _free_count--;
+                self.free_count++;
+            }
+        }
+        if (!self.free_nodes) {
+            return new task_node;
+        }
+        self.free_count--;
+        return std::exchange(self.free_nodes, self.free_nodes->next);
+    }
+
+    void release_node(worker &self, task_node *node)
+    {
+        // whatever the task captured is released right away, not once the node is reused
+        node->task = {};
+        node->next = std::exchange(self.free_nodes, node);
+        if (++self.free_count <= LOCAL_CACHED_NODES) {
+            return;
+        }
+        // nodes of tasks from other threads pile up here, hand half of them back in one go
+        task_node *surplus = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            while (self.free_count > LOCAL_CACHED_NODES / 2) {
+                task_node *spare = std::exchange(self.free_nodes, self.free_nodes->next);
+                self.free_count--;
+                if (_free_count < MAX_CACHED_NODES) {
+                    spare->next = std::exchange(_free_nodes, spare);
+                    _free_count++;
+                } else {
+                    spare->next = std::exchange(surplus, spare);
+                }
+            }
+        }
+        delete_nodes(surplus);
+    }
+
+    lane &lane_of(TaskPriority priority)
+    {
+        return _lanes[static_cast<std::size_t>(priority)];
+    }
+
+    task_node *take_shared(worker &self, lane &from)
+    {
+        if (from.count == 0) {
+            return nullptr;
+        }
+        if (from.bounded) {
+            task_node *node = acquire_local_node(self);
+            if (!from.bounded->try_pop(*node)) {
+                // the node is still empty, no need to go through release_node
+                node->next = std::exchange(self.free_nodes, node);
+                self.free_count++;
+                return nullptr;
+            }
+            from.count--;
+            if (_blocked_submitters > 0) {
+                { std::lock_guard<std::mutex> lock(_mutex); }
+                _cv_free_slot.notify_one();
+            }
+            return node;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!from.head) {
+            return nullptr;
+        }
+        task_node *node = std::exchange(from.head, from.head->next);
+        if (!from.head) {
+            from.tail = nullptr;
+        }
+        from.count--;
+        return node;
+    }
+
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // the high lane first, then the own deque, since its tasks are the most likely to be cache hot,
+    // then the normal lane, the deques of the others, and the low lane last
+    task_node *find_task(worker &self, std::size_t index)
+    {
+        task_node *task = nullptr;
+        if (_config.starvation_interval && (self.picked_in_order >= _config.starvation_interval)) {
+            self.picked_in_order = 0;
+            task = take_shared(self, lane_of(TaskPriority::low));
+            if (!task) {
+                task = take_shared(self, lane_of(TaskPriority::normal));
+            }
+        }
+        if (!task) {
+            task = take_shared(self, lane_of(TaskPriority::high));
+        }
+        if (!task) {
+            task = self.tasks.pop();
+        }
+        if (!task) {
+            task = take_shared(self, lane_of(TaskPriority::normal));
+        }
+        const std::size_t slot_count = _slot_count;
+        for (std::size_t i = 1; !task && (i < slot_count); ++i) {
+            task = _workers[(index + i) % slot_count]->tasks.steal();
+        }
+        if (!task) {
+            task = take_shared(self, lane_of(TaskPriority::low));
+        }
+        if (task) {
+            _queued--;
+            self.picked_in_order++;
+        }
+        return task;
+    }
+
+    void worker_loop(worker &self, std::size_t index)
+    {
+        tls_pool = this;
+        tls_worker = &self;
+        if (!_cpus.empty()) {
+            cpu_affinity::pin_current_thread(_cpus[index % _cpus.size()]);
+        }
+        std::size_t idle_rounds = 0;
+        bool idle = true;
+        while (_active) {
+            task_node *node = find_task(self, index);
+            if (node) {
+                idle_rounds = 0;
+                if (idle) {
+                    // only flipped on the way in and out of a run of tasks, not for every task
+                    idle = false;
+                    _idle--;
+                }
+                if (node->enqueued_at) {
+                    const int64_t picked_up = now();
+                    _last_pickup = picked_up;
+                    if (picked_up - node->enqueued_at > _max_queue_delay) {
+                        grow();
                     }
+                }
+                try {
+                    // actually execute the task
+                    node->task();
+                } catch (...) {
+                    // a posted task has nobody to report to, like an add_task whose future is dropped
+                }
+                release_node(self, node);
+                continue;
+            }
+            if (!idle) {
+                idle = true;
+                _idle++;
+            }
+            // a task may show up any moment, so only sleep once it didn't for a while
+            if (idle_rounds++ < _config.spin_rounds) {
+                std::this_thread::yield();
+                continue;
+            }
+            idle_rounds = 0;
+            std::unique_lock<std::mutex> lock(_mutex);
+            _sleeping++;
+            // we wait either until there is at least one task
+            // in any queue, or until we shutdown this thing
+            auto has_work = [this] { return (_queued > 0) || (!_active); };
+            bool woken = true;
+            if (_config.keep_alive.count() > 0) {
+                woken = _cv_new_job.wait_for(lock, _config.keep_alive, has_work);
+            } else {
+                _cv_new_job.wait(lock, has_work);
+            }
+            _sleeping--;
+            // still holding the mutex, so a submitter can't pick this worker to notify any more
+            if (!woken && retire(self)) {
+                return;
+            }
+        }
+    }
+
+    // requires _size_mutex
+    void start_worker(std::size_t index)
+    {
+        worker &slot = *_workers[index];
+        if (slot.thread.joinable()) {
+            // a retired thread, which is gone or about to be
+            slot.thread.join();
+        }
+        slot.running = true;
+        _thread_count++;
+        // counted before it runs, so submitters don't start yet another one in the meantime
+        _idle++;
+        _slot_count = std::max<std::size_t>(_slot_count, index + 1);
+        slot.thread = std::thread(&thread_pool::worker_loop, this, std::ref(slot), index);
+    }
+
+    // starts another thread if none is idle, up to the max
+    void grow()
+    {
+        if ((_idle > 0) || (_thread_count >= _workers.size())) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_size_mutex);
+        grow_locked();
+    }
+
+    // requires _size_mutex
+    void grow_locked()
+    {
+        if ((_idle > 0) || !_active) {
+            return;
+        }
+        for (std::size_t i = 0; i < _workers.size(); ++i) {
+            if (!_workers[i]->running) {
+                start_worker(i);
+                return;
+            }
+        }
+    }
 
-                    task = std::move(_task_queue.front());
-                    _task_queue.pop();
+    // makes sure somebody looks at the queue again after max_queue_delay, even if every worker stays busy
+    void arm_watchdog()
+    {
+        if (_watchdog_armed || (_thread_count >= _workers.size()) || _watchdog_armed.exchange(true)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_size_mutex);
+        if (!_active) {
+            return;
+        }
+        if (!_watchdog.joinable()) {
+            _watchdog = std::thread(&thread_pool::watchdog_loop, this);
+        }
+        _cv_watchdog.notify_one();
+    }
+
+    void watchdog_loop()
+    {
+        std::unique_lock<std::mutex> lock(_size_mutex);
+        while (_active) {
+            _cv_watchdog.wait(lock, [this] { return _watchdog_armed || !_active; });
+            // only shutdown cuts this short, tasks picked up in the meantime are seen by the check below
+            if (_cv_watchdog.wait_for(lock, _config.max_queue_delay, [this] { return !_active; })) {
+                break;
+            }
+            _watchdog_armed = false;
+            if ((_queued > 0) && (_idle == 0)) {
+                grow_locked();
+            }
+        }
+    }
+
+    // lets the calling worker go, unless it is needed for the warm pool
+    bool retire(worker &self)
+    {
+        std::lock_guard<std::mutex> lock(_size_mutex);
+        // only the owner pushes to its deque, so if it is empty now it stays empty
+        if ((_thread_count <= _min_threads) || !self.tasks.empty()) {
+            return false;
+        }
+        self.running = false;
+        _thread_count--;
+        _idle--;
+        return true;
+    }
+
+    static void run_inline(unique_task &task)
+    {
+        try {
+            task();
+        } catch (...) {
+        }
+    }
+
+    // returns false if the task didn't go into the queue, because it was run or dropped according to the policy
+    bool push_bounded(lane &to, unique_task &task, int64_t enqueued_at)
+    {
+        to.count++;
+        queued_task entry{std::move(task), enqueued_at};
+        while (!to.bounded->try_push(std::move(entry))) {
+            if ((_config.queue_full_policy == QueueFullPolicy::block) && (tls_pool != this)) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                // counted before trying again, so a worker freeing a slot right after the attempt notifies us
+                _blocked_submitters++;
+                while (_active && !to.bounded->try_push(std::move(entry))) {
+                    _cv_free_slot.wait(lock);
                 }
-                // actually execute the task
-                task();
+                _blocked_submitters--;
+                if (_active) {
+                    return true;
+                }
+            }
+            to.count--;
+            // handed back, so dropping it happens where the caller expects
+            task = std::move(entry.task);
+            if (_config.queue_full_policy != QueueFullPolicy::reject) {
+                run_inline(task);
             }
-        };
-        _thread_pool.emplace_back(std::thread(thread_worker_fun));
+            return false;
+        }
+        return true;
     }
-    void create_threads(std::size_t thread_count)
+
+    std::error_condition submit(TaskPriority priority, unique_task &&task)
     {
-        _thread_pool.reserve(thread_count + _thread_pool.size());
-        for (uint32_t i = 0; i < thread_count; ++i) {
-            add_thread();
+        int64_t enqueued_at = 0;
+        if (_idle == 0) {
+            // every worker is busy, so this task may have to wait. If none was picked up in a while, the
+            // workers are stuck in long tasks and another one is needed right away
+            enqueued_at = now();
+            if ((_queued > 0) && (enqueued_at - _last_pickup > _max_queue_delay)) {
+                grow();
+            }
+            arm_watchdog();
+        }
+        // counted first, so a worker that finds the task never sees the count drop below zero
+        _queued++;
+        lane &to = lane_of(priority);
+        if ((priority == TaskPriority::normal) && (_config.scheduling == PoolScheduling::work_stealing) && (tls_pool == this)) {
+            task_node *node = acquire_local_node(*tls_worker);
+            node->task = std::move(task);
+            node->enqueued_at = enqueued_at;
+            tls_worker->tasks.push(node);
+        } else if (to.bounded) {
+            if (!push_bounded(to, task, enqueued_at)) {
+                _queued--;
+                if (_config.queue_full_policy == QueueFullPolicy::reject) {
+                    return std::errc::resource_unavailable_try_again;
+                }
+                return {};
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(_mutex);
+            task_node *node = acquire_shared_node();
+            node->task = std::move(task);
+            node->enqueued_at = enqueued_at;
+            node->next = nullptr;
+            (to.tail ? to.tail->next : to.head) = node;
+            to.tail = node;
+            to.count++;
         }
+        if (_sleeping > 0) {
+            // a worker between checking for tasks and waiting holds the mutex, so it can't miss this
+            { std::lock_guard<std::mutex> lock(_mutex); }
+            _cv_new_job.notify_one();
+        }
+        return {};
     }
 
-private:
     thread_pool(std::size_t start_threads, std::size_t max_threads)
+        : thread_pool(thread_pool_config{.start_threads = start_threads, .max_threads = max_threads})
     {
-        _active = true;
-        _max_threads = max_threads;
-        create_threads(start_threads);
     }
 
 public:
-    thread_pool()
+    thread_pool() : thread_pool(thread_pool_config{})
+    {
+    }
+
+    explicit thread_pool(const thread_pool_config &config)
+        : _config(config),
+          _max_queue_delay(std::chrono::duration_cast<std::chrono::nanoseconds>(config.max_queue_delay).count())
     {
+        const std::size_t max_threads =
+            std::max<std::size_t>(config.max_threads ? config.max_threads : std::thread::hardware_concurrency(), 1);
+        _min_threads = std::clamp<std::size_t>(config.min_threads, 1, max_threads);
+        _cpus = cpu_affinity::resolve(config.affinity).first;
+        if (config.queue_capacity > 0) {
+            for (lane &each : _lanes) {
+                each.bounded = std::make_unique<mpmc_queue<queued_task>>(config.queue_capacity);
+            }
+        }
+        _workers.reserve(max_threads);
+        for (std::size_t i = 0; i < max_threads; ++i) {
+            _workers.push_back(std::make_unique<worker>());
+        }
         _active = true;
-        _max_threads = std::thread::hardware_concurrency();
-        create_threads(1);
+        std::lock_guard<std::mutex> lock(_size_mutex);
+        for (std::size_t i = 0; i < std::clamp<std::size_t>(config.start_threads, _min_threads, max_threads); ++i) {
+            start_worker(i);
+        }
     }
 
     // only way to influence the max threads is via template
@@ -76,53 +571,193 @@ public:
 
     ~thread_pool()
     {
-        _active = false;
+        {
+            std::scoped_lock lock(_mutex, _size_mutex);
+            _active = false;
+        }
         _cv_new_job.notify_all();
-        for (auto &thread : _thread_pool) {
-            thread.join();
+        _cv_free_slot.notify_all();
+        _cv_watchdog.notify_all();
+        if (_watchdog.joinable()) {
+            _watchdog.join();
+        }
+        for (auto &slot : _workers) {
+            if (slot->thread.joinable()) {
+                slot->thread.join();
+            }
+        }
+        // tasks nobody got to any more
+        for (lane &each : _lanes) {
+            delete_nodes(each.head);
+        }
+        delete_nodes(_free_nodes);
+        for (auto &slot : _workers) {
+            while (task_node *node = slot->tasks.pop()) {
+                delete node;
+            }
+            delete_nodes(slot->free_nodes);
         }
     }
 
+    /*!
+     * @brief The pool shared by every client which wasn't given one of its own. Created on first use,
+     * with one thread at first. Async client operations mostly wait on their socket, so it grows well
+     * beyond the hardware threads, a client blocked in a long receive mustn't hold up the others.
+     * Threads idle for longer than the keep alive exit again.
+     */
+    static std::shared_ptr<thread_pool> get_default()
+    {
+        static const std::shared_ptr<thread_pool> default_pool = std::make_shared<thread_pool>(thread_pool_config{
+            .max_threads = std::max<std::size_t>(DEFAULT_POOL_MIN_MAX_THREADS,
+                                                 DEFAULT_POOL_THREADS_PER_CPU * std::thread::hardware_concurrency())});
+        return default_pool;
+    }
+
     std::size_t get_thread_count()
     {
-        return _thread_pool.size();
+        return _thread_count;
+    }
+    std::size_t get_max_thread_count() const
+    {
+        return _workers.size();
+    }
+    // 0 if the shared queue is unbounded
+    [[nodiscard]] std::size_t get_queue_capacity() const
+    {
+        return _config.queue_capacity;
+    }
+    [[nodiscard]] QueueFullPolicy get_queue_full_policy() const
+    {
+        return _config.queue_full_policy;
     }
     std::size_t get_task_count()
     {
-        std::lock_guard<std::mutex> lock(_mutex);
-        return _task_queue.size();
+        return _queued;
+    }
+    /*!
+     * @brief Queues \p function to be called with \p args, without a way to wait for it or get its result.
+     * Exceptions it throws are dropped. Doesn't allocate once the pool is warmed up, as long as
+     * the function and its arguments fit into a `unique_task`.
+     *
+     * @return Returns `std::errc::resource_unavailable_try_again` if the bounded queue was full and
+     * the task got rejected.
+     */
+    template <typename FUNCTION, typename... FUNCARGS>
+        requires(!std::is_same_v<std::remove_cvref_t<FUNCTION>, TaskPriority>)
+    std::error_condition post(FUNCTION &&function, FUNCARGS &&...args)
+    {
+        return post(TaskPriority::normal, std::forward<FUNCTION>(function), std::forward<FUNCARGS>(args)...);
     }
+
+    // like `post`, but the task waits in the lane of \p priority
+    template <typename FUNCTION, typename... FUNCARGS>
+    std::error_condition post(TaskPriority priority, FUNCTION &&function, FUNCARGS &&...args)
+    {
+        if constexpr (sizeof...(FUNCARGS) == 0) {
+            return submit(priority, unique_task(std::forward<FUNCTION>(function)));
+        } else {
+            return submit(priority, unique_task(
+                [function = std::forward<FUNCTION>(function), ... args = std::forward<FUNCARGS>(args)]() mutable {
+                    std::invoke(function, args...);
+                }));
+        }
+    }
+
     // https://stackoverflow.com/a/31078143
-    template <typename FUNCTION, typename... FUNCARGS> auto add_task(FUNCTION &&function, FUNCARGS &&...args)
+    template <typename FUNCTION, typename... FUNCARGS>
+        requires(!std::is_same_v<std::remove_cvref_t<FUNCTION>, TaskPriority>)
+    auto add_task(FUNCTION &&function, FUNCARGS &&...args)
     {
-        // first, check if we even have a free thread
-        // if not, we add one up to a max allowed
-        std::size_t free_threads = (get_thread_count() - get_task_count());
-        if (!free_threads) {
-            if (_thread_pool.size() < _max_threads) {
-                create_threads(1);
+        return add_task(TaskPriority::normal, std::forward<FUNCTION>(function), std::forward<FUNCARGS>(args)...);
+    }
+
+    template <typename FUNCTION, typename... FUNCARGS>
+    auto add_task(TaskPriority priority, FUNCTION &&function, FUNCARGS &&...args)
+    {
+        // the function is called with its stored arguments as lvalues, like std::bind would
+        using return_type = std::invoke_result_t<std::decay_t<FUNCTION> &, std::decay_t<FUNCARGS> &...>;
+        // the shared state of the future comes from the block pool instead of the heap
+        std::promise<return_type> promise(std::allocator_arg, pooled_allocator<std::byte>(_state_pool));
+        auto future = promise.get_future();
+        submit(priority, unique_task([promise = std::move(promise),
+                                      function = std::forward<FUNCTION>(function),
+                                      ... args = std::forward<FUNCARGS>(args)]() mutable {
+            try {
+                if constexpr (std::is_void_v<return_type>) {
+                    std::invoke(function, args...);
+                    promise.set_value();
+                } else {
+                    promise.set_value(std::invoke(function, args...));
+                }
+            } catch (...) {
+                promise.set_exception(std::current_exception());
             }
+        }));
+        return future;
+    }
+};
+
+/*!
+ * @brief Counts the tasks an object handed to a thread pool it doesn't own, so it can wait
+ * for them before it goes away.
+ *
+ * Every task captures a `token`, which counts until it is destroyed. That happens once the
+ * task ran, and also if the pool dropped the task without running it.
+ */
+class task_tracker {
+private:
+    std::atomic<std::size_t> _count = 0;
+    std::mutex _mutex;
+    std::condition_variable _cv_done;
+
+    void release()
+    {
+        if (--_count == 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _cv_done.notify_all();
         }
-        // we need the return type of the task we are given (C++17)
-        using return_type = std::invoke_result_t<FUNCTION, FUNCARGS...>;
-        // crate ptr which we then use to get a future later
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
-            // execute function with provided arg reference via forward call wrapper
-            std::bind(std::forward<FUNCTION>(function), std::forward<FUNCARGS>(args)...));
+    }
 
+public:
+    class token {
+    private:
+        task_tracker *_tracker;
+
+    public:
+        explicit token(task_tracker *tracker) : _tracker(tracker)
         {
-            std::unique_lock<std::mutex> lock(_mutex);
-            // we actually emplace a lambda which then executes the function with args
-            // we got passed here. Function is encoded in the std::packaged_task
-            _task_queue.emplace([task]() -> void {
-                // deref shared_ptr and execute function
-                (*task)();
-            });
-        }
-        // notify a waiting thread that there's a new task
-        _cv_new_job.notify_one();
-        // call get_future of the packaged_task
-        return task->get_future();
+        }
+        token(token &&other) noexcept : _tracker(std::exchange(other._tracker, nullptr))
+        {
+        }
+        token &operator=(token &&) = delete;
+        token(const token &) = delete;
+        token &operator=(const token &) = delete;
+        ~token()
+        {
+            if (_tracker) {
+                _tracker->release();
+            }
+        }
+    };
+
+    token acquire()
+    {
+        _count++;
+        return token(this);
+    }
+
+    // must not be called from a tracked task, it would wait for itself
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv_done.wait(lock, [this] { return _count == 0; });
+    }
+
+    // tasks queued or running
+    [[nodiscard]] std::size_t get_count() const
+    {
+        return _count;
     }
 };
 } // namespace netlib
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace netlib {
+
+/*!
+ * @brief Hierarchical hashed timer wheel.
+ *
+ * Time advances in ticks of a fixed resolution. Four levels of 256 slots cover 2^32 ticks,
+ * timers further out wait in the last level. Scheduling and cancelling are O(1), and
+ * advancing by one tick only touches the timers which are due, plus the occasional
+ * cascade of a higher level slot into the levels below.
+ *
+ * Every method may be called from any thread, but timers only run in `advance`, on the
+ * thread calling it. Timers may schedule or cancel timers, including themselves.
+ */
+class timer_wheel {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    static constexpr std::size_t LEVEL_COUNT = 4;
+    static constexpr std::size_t SLOT_BITS = 8;
+    static constexpr std::size_t SLOT_COUNT = 1 << SLOT_BITS;
+    static constexpr uint64_t SLOT_MASK = SLOT_COUNT - 1;
+
+    struct timer {
+        uint64_t expiry_tick = 0;
+        // ticks between runs of periodic timers, 0 for one-shot timers
+        uint64_t interval_ticks = 0;
+        std::function<void()> task;
+    };
+
+    std::mutex _mutex;
+    std::chrono::milliseconds _resolution;
+    clock::time_point _start = clock::now();
+    uint64_t _current_tick = 0;
+    uint64_t _next_id = 1;
+    // cancelling only erases the timer here, slots may still hold its id until they are processed
+    std::unordered_map<uint64_t, timer> _timers;
+    std::array<std::array<std::vector<uint64_t>, SLOT_COUNT>, LEVEL_COUNT> _slots{};
+
+    uint64_t to_ticks(std::chrono::milliseconds duration) const
+    {
+        // rounded up, timers never run early
+        return (std::max<int64_t>(duration.count(), 0) + _resolution.count() - 1) / _resolution.count();
+    }
+
+    uint64_t tick_of(clock::time_point time_point) const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(time_point - _start).count() / _resolution.count());
+    }
+
+    // slots up to \p earliest_tick are already processed, so anything before goes there
+    void place(uint64_t id, uint64_t expiry_tick, uint64_t earliest_tick)
+    {
+        expiry_tick = std::max(expiry_tick, earliest_tick);
+        const uint64_t delta = expiry_tick - _current_tick;
+        for (std::size_t level = 0; level < LEVEL_COUNT; ++level) {
+            if ((delta < (uint64_t(1) << (SLOT_BITS * (level + 1)))) || (level == LEVEL_COUNT - 1)) {
+                _slots[level][(expiry_tick >> (SLOT_BITS * level)) & SLOT_MASK].push_back(id);
+                return;
+            }
+        }
+    }
+
+    // moves the timers of a higher level slot down, once the wheel below wrapped around
+    void cascade(std::size_t level)
+    {
+        std::vector<uint64_t> ids;
+        ids.swap(_slots[level][(_current_tick >> (SLOT_BITS * level)) & SLOT_MASK]);
+        for (uint64_t id : ids) {
+            auto it = _timers.find(id);
+            if (it != _timers.end()) {
+                // cascading happens before the current level 0 slot is processed, so it may still be used
+                place(id, it->second.expiry_tick, _current_tick);
+            }
+        }
+    }
+
+public:
+    explicit timer_wheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(10))
+        : _resolution(std::max(resolution, std::chrono::milliseconds(1)))
+    {
+    }
+
+    /*!
+     * @brief Runs \p task once \p delay passed, and then every \p interval if that is positive.
+     *
+     * @return Returns an id for `cancel`, never 0.
+     */
+    uint64_t schedule(std::chrono::milliseconds delay, std::function<void()> task,
+                      std::chrono::milliseconds interval = std::chrono::milliseconds(0))
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const uint64_t id = _next_id++;
+        const uint64_t expiry_tick = tick_of(clock::now()) + to_ticks(delay);
+        _timers.emplace(id, timer{.expiry_tick = expiry_tick,
+                                  .interval_ticks = (interval.count() > 0) ? std::max<uint64_t>(to_ticks(interval), 1) : 0,
+                                  .task = std::move(task)});
+        place(id, expiry_tick, _current_tick + 1);
+        return id;
+    }
+
+    // returns false if the timer already ran (unless periodic) or was cancelled before
+    bool cancel(uint64_t id)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _timers.erase(id) > 0;
+    }
+
+    /*!
+     * @brief Runs all timers which are due at \p now, in order of their expiry.
+     *
+     * @return Returns the amount of timers that ran.
+     */
+    std::size_t advance(clock::time_point now = clock::now())
+    {
+        std::size_t ran = 0;
+        const uint64_t target_tick = tick_of(now);
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_timers.empty()) {
+            // nothing can be due, so there's no need to walk the slots
+            _current_tick = std::max(_current_tick, target_tick);
+        }
+        while (_current_tick < target_tick) {
+            _current_tick++;
+            for (std::size_t level = LEVEL_COUNT - 1; level > 0; --level) {
+                // a level cascades once all levels below it wrapped around
+                if ((_current_tick & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) == 0) {
+                    cascade(level);
+                }
+            }
+            std::vector<uint64_t> due;
+            due.swap(_slots[0][_current_tick & SLOT_MASK]);
+            for (uint64_t id : due) {
+                auto it = _timers.find(id);
+                if (it == _timers.end()) {
+                    continue;
+                }
+                if (it->second.expiry_tick > _current_tick) {
+                    // only possible for timers beyond the range of the last level
+                    place(id, it->second.expiry_tick, _current_tick + 1);
+                    continue;
+                }
+                std::function<void()> task;
+                if (it->second.interval_ticks) {
+                    it->second.expiry_tick = _current_tick + it->second.interval_ticks;
+                    place(id, it->second.expiry_tick, _current_tick + 1);
+                    task = it->second.task;
+                } else {
+                    task = std::move(it->second.task);
+                    _timers.erase(it);
+                }
+                lock.unlock();
+                task();
+                ran++;
+                lock.lock();
+            }
+        }
+        return ran;
+    }
+
+    [[nodiscard]] std::size_t size()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _timers.size();
+    }
+
+    [[nodiscard]] std::chrono::milliseconds get_resolution() const
+    {
+        return _resolution;
+    }
+};
+
+} // namespace netlib
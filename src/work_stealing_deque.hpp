@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace netlib {
+
+/*!
+ * @brief Chase-Lev work stealing deque of pointers, after "Correct and Efficient Work-Stealing
+ * for Weak Memory Models" (Lê et al., 2013).
+ *
+ * Only the owning thread may `push` and `pop`, which work on the bottom end in LIFO order.
+ * Any thread may `steal` from the top end, in FIFO order. The ring grows when full. Rings
+ * that were outgrown are kept until the deque is destroyed, since a thief may still read
+ * from one, so memory only ever grows to the largest backlog.
+ */
+template <typename T> class work_stealing_deque {
+private:
+    struct ring {
+        int64_t capacity;
+        std::unique_ptr<std::atomic<T *>[]> slots;
+
+        explicit ring(int64_t ring_capacity) : capacity(ring_capacity), slots(new std::atomic<T *>[ring_capacity])
+        {
+        }
+
+        // capacity is a power of two, so masking replaces the modulo
+        [[nodiscard]] T *get(int64_t index) const
+        {
+            return slots[index & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T *item)
+        {
+            slots[index & (capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+    };
+
+    std::atomic<int64_t> _top = 0;
+    std::atomic<int64_t> _bottom = 0;
+    std::atomic<ring *> _ring;
+    // owner only, every ring ever used, including the current one
+    std::vector<std::unique_ptr<ring>> _rings;
+
+    ring *grow(ring *old_ring, int64_t bottom, int64_t top)
+    {
+        auto new_ring = std::make_unique<ring>(old_ring->capacity * 2);
+        for (int64_t i = top; i < bottom; ++i) {
+            new_ring->put(i, old_ring->get(i));
+        }
+        ring *raw_ring = new_ring.get();
+        _rings.push_back(std::move(new_ring));
+        _ring.store(raw_ring, std::memory_order_release);
+        return raw_ring;
+    }
+
+public:
+    explicit work_stealing_deque(int64_t initial_capacity = 256)
+    {
+        int64_t capacity = 1;
+        while (capacity < initial_capacity) {
+            capacity <<= 1;
+        }
+        _rings.push_back(std::make_unique<ring>(capacity));
+        _ring.store(_rings.back().get(), std::memory_order_relaxed);
+    }
+
+    work_stealing_deque(const work_stealing_deque &) = delete;
+    work_stealing_deque &operator=(const work_stealing_deque &) = delete;
+
+    // owner only
+    void push(T *item)
+    {
+        const int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        const int64_t top = _top.load(std::memory_order_acquire);
+        ring *current = _ring.load(std::memory_order_relaxed);
+        if (bottom - top > current->capacity - 1) {
+            current = grow(current, bottom, top);
+        }
+        current->put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // owner only, returns the most recently pushed item or nullptr if empty
+    T *pop()
+    {
+        const int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        ring *current = _ring.load(std::memory_order_relaxed);
+        _bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = _top.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T *item = current->get(bottom);
+        if (top == bottom) {
+            // last item, race against thieves for it
+            if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread, returns the oldest item, or nullptr if empty or another thread got it first
+    T *steal()
+    {
+        int64_t top = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = _bottom.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return nullptr;
+        }
+        T *item = _ring.load(std::memory_order_acquire)->get(top);
+        if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    // only a snapshot, other threads may change it at any time
+    [[nodiscard]] bool empty() const
+    {
+        return _bottom.load(std::memory_order_relaxed) <= _top.load(std::memory_order_relaxed);
+    }
+};
+
+} // namespace netlib
@@ -0,0 +1,91 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <numeric>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+static netlib::shard_stats total_stats(netlib::server &server)
+{
+    netlib::shard_stats total;
+    for (const netlib::shard_stats &stats : server.get_shard_stats()) {
+        total.accepted_connections += stats.accepted_connections;
+        total.rejected_connections += stats.rejected_connections;
+        total.rejected_by_source += stats.rejected_by_source;
+    }
+    return total;
+}
+
+static bool is_closed_by_server(netlib::client &client)
+{
+    std::error_condition recv_error = client.recv(1, 500ms).second;
+    return recv_error && (recv_error != std::errc::timed_out);
+}
+
+TEST_CASE("Connections beyond the limit are rejected")
+{
+    netlib::server server;
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, {.max_connections = 2}));
+
+    std::vector<netlib::client> clients(3);
+    for (netlib::client &client : clients) {
+        CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+        std::this_thread::sleep_for(50ms);
+    }
+    CHECK_FALSE(is_closed_by_server(clients[0]));
+    CHECK_FALSE(is_closed_by_server(clients[1]));
+    CHECK(is_closed_by_server(clients[2]));
+    CHECK_EQ(server.get_client_count(), 2);
+    CHECK_EQ(total_stats(server).rejected_connections, 1);
+
+    // a closed connection makes room again
+    clients[0].disconnect();
+    std::this_thread::sleep_for(100ms);
+    netlib::client late_client;
+    CHECK_FALSE(late_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    CHECK_FALSE(is_closed_by_server(late_client));
+    CHECK_EQ(server.get_client_count(), 2);
+    server.stop();
+}
+
+TEST_CASE("Delayed connections are accepted once there is room")
+{
+    netlib::server server;
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP,
+                              {.max_connections = 1, .admission_policy = netlib::AdmissionPolicy::delay}));
+
+    netlib::client first_client;
+    CHECK_FALSE(first_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    std::this_thread::sleep_for(50ms);
+    // the handshake completes in the kernel, the connection just waits in the backlog
+    netlib::client waiting_client;
+    CHECK_FALSE(waiting_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    std::this_thread::sleep_for(100ms);
+    CHECK_EQ(server.get_client_count(), 1);
+    CHECK_EQ(total_stats(server).accepted_connections, 1);
+
+    first_client.disconnect();
+    std::this_thread::sleep_for(200ms);
+    CHECK_EQ(server.get_client_count(), 1);
+    CHECK_EQ(total_stats(server).accepted_connections, 2);
+    CHECK_EQ(total_stats(server).rejected_connections, 0);
+    CHECK_FALSE(is_closed_by_server(waiting_client));
+    server.stop();
+}
+
+TEST_CASE("Connections per source address are limited")
+{
+    netlib::server server;
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP,
+                              {.max_connections_per_source = 2}));
+
+    std::vector<netlib::client> clients(3);
+    for (netlib::client &client : clients) {
+        CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+        std::this_thread::sleep_for(50ms);
+    }
+    CHECK(is_closed_by_server(clients[2]));
+    CHECK_EQ(server.get_client_count(), 2);
+    CHECK_EQ(total_stats(server).rejected_by_source, 1);
+    server.stop();
+}
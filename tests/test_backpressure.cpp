@@ -0,0 +1,47 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Reading pauses while a client doesn't take its answers")
+{
+    constexpr std::size_t request_count = 20;
+    const std::vector<uint8_t> large_answer(1024 * 1024, 0x33);
+    std::atomic<std::size_t> handled_requests = 0;
+    std::atomic<std::size_t> pauses = 0;
+    std::atomic<std::size_t> resumes = 0;
+
+    netlib::server server;
+    // one callback per request byte, so reading can stop in between
+    server.set_framer(std::make_shared<netlib::fixed_size_framer>(1));
+    server.register_callback_on_recv_span([&](netlib::client_endpoint endpoint, std::span<const uint8_t> data) -> netlib::server_response {
+        handled_requests++;
+        return {.answer = large_answer};
+    });
+    server.register_callback_on_flow_control([&](netlib::client_endpoint endpoint, bool paused) {
+        (paused ? pauses : resumes)++;
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP,
+                              {.high_watermark = 64 * 1024, .low_watermark = 16 * 1024}));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    CHECK_FALSE(client.send(std::vector<uint8_t>(request_count, 1), 100ms).second);
+    std::this_thread::sleep_for(200ms);
+    CHECK_GT(pauses, 0);
+    CHECK_LT(handled_requests, request_count);
+    CHECK_LE(server.get_pending_bytes(), 64 * 1024 + large_answer.size());
+
+    std::size_t received = 0;
+    auto start = std::chrono::steady_clock::now();
+    while ((received < request_count * large_answer.size()) && (std::chrono::steady_clock::now() - start < 10s)) {
+        received += client.recv(0, 50ms).first.size();
+    }
+    CHECK_EQ(received, request_count * large_answer.size());
+    CHECK_EQ(handled_requests, request_count);
+    CHECK_EQ(resumes, pauses);
+    CHECK_EQ(server.get_pending_bytes(), 0);
+    server.stop();
+}
@@ -0,0 +1,53 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Buffer pool recycles slabs")
+{
+    auto pool = netlib::buffer_pool::create(64, 2);
+    {
+        netlib::pooled_buffer first = pool->acquire();
+        netlib::pooled_buffer second = pool->acquire();
+        CHECK_EQ(first.capacity(), 64);
+        CHECK(first.empty());
+        first.resize(10);
+        CHECK_EQ(first.get_span().size(), 10);
+        CHECK_EQ(pool->get_allocation_count(), 2);
+    }
+    CHECK_EQ(pool->get_cached_count(), 2);
+    for (int i = 0; i < 100; ++i) {
+        netlib::pooled_buffer buffer = pool->acquire();
+        netlib::pooled_buffer moved = std::move(buffer);
+        CHECK(buffer.data() == nullptr);
+    }
+    CHECK_EQ(pool->get_allocation_count(), 2);
+}
+
+TEST_CASE("Pooled receive path stops allocating in steady state")
+{
+    netlib::server server;
+    server.register_callback_on_recv_buffer([&](netlib::client_endpoint endpoint, netlib::pooled_buffer data) -> netlib::server_response {
+        return {.answer = std::vector<uint8_t>(data.begin(), data.end())};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    const std::vector<uint8_t> payload(1000, 0x42);
+    auto round_trip = [&]() {
+        CHECK_FALSE(client.send(payload, 100ms).second);
+        auto recv_res = client.recv(payload.size(), 1000ms);
+        CHECK_FALSE(recv_res.second);
+        CHECK(recv_res.first == payload);
+    };
+    round_trip();
+    std::size_t warm_allocations = server.get_shard_stats().front().receive_buffer_allocations;
+    CHECK_GT(warm_allocations, 0);
+    for (int i = 0; i < 50; ++i) {
+        round_trip();
+    }
+    CHECK_EQ(server.get_shard_stats().front().receive_buffer_allocations, warm_allocations);
+    server.stop();
+}
@@ -0,0 +1,41 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Connection storm is accepted in one go")
+{
+    static constexpr std::size_t CLIENT_COUNT = 200;
+
+    netlib::server server;
+    std::atomic<std::size_t> connect_count = 0;
+    server.register_callback_on_connect([&](netlib::client_endpoint endpoint) -> netlib::server_response {
+        connect_count++;
+        // a slow connect callback must not hold up the accept path
+        std::this_thread::sleep_for(5ms);
+        return {};
+    });
+
+    std::error_condition server_create_res = server.create("localhost", test_port, netlib::AddressFamily::IPv4,
+                                                           netlib::AddressProtocol::TCP, {.accept_queue_size = CLIENT_COUNT});
+    CHECK_FALSE(server_create_res);
+
+    std::vector<netlib::client> clients(CLIENT_COUNT);
+    auto start = std::chrono::steady_clock::now();
+    for (auto &client : clients) {
+        CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    }
+    while ((server.get_shard_stats().front().accepted_connections < CLIENT_COUNT) && (std::chrono::steady_clock::now() - start < 5s)) {
+        std::this_thread::sleep_for(1ms);
+    }
+    // the old accept loop slept 10ms per connection, which would have taken 2s here
+    CHECK_LT(std::chrono::steady_clock::now() - start, 1000ms);
+    CHECK_EQ(server.get_client_count(), CLIENT_COUNT);
+
+    while ((connect_count < CLIENT_COUNT) && (std::chrono::steady_clock::now() - start < 5s)) {
+        std::this_thread::sleep_for(1ms);
+    }
+    CHECK_EQ(connect_count, CLIENT_COUNT);
+}
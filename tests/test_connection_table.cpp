@@ -0,0 +1,73 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Connection table handles go stale on reuse")
+{
+    netlib::connection_table<int> table;
+    auto first = table.insert();
+    CHECK(first.has_value());
+    {
+        auto [lock, value] = table.lock(first.value());
+        CHECK(value != nullptr);
+        *value = 42;
+        table.erase(first.value());
+    }
+    CHECK_EQ(table.size(), 0);
+
+    // the freed slot is handed out again, but with a new generation
+    auto second = table.insert();
+    CHECK(second.has_value());
+    CHECK_EQ(second->index, first->index);
+    CHECK_NE(second->generation, first->generation);
+    CHECK(table.lock(first.value()).second == nullptr);
+    auto [lock, value] = table.lock(second.value());
+    CHECK(value != nullptr);
+    CHECK_EQ(*value, 0);
+}
+
+TEST_CASE("Connection table grows beyond one chunk")
+{
+    netlib::connection_table<int> table;
+    std::vector<netlib::connection_table<int>::handle> handles;
+    for (uint32_t i = 0; i < 3 * netlib::connection_table<int>::CHUNK_SIZE; ++i) {
+        handles.push_back(table.insert().value());
+    }
+    CHECK_EQ(table.size(), handles.size());
+    std::size_t visited = 0;
+    table.for_each([&](netlib::connection_table<int>::handle, int &) {
+        visited++;
+    });
+    CHECK_EQ(visited, handles.size());
+}
+
+TEST_CASE("Server endpoint ids survive fd reuse")
+{
+    netlib::server server;
+    std::vector<netlib::client_endpoint> endpoints;
+    std::mutex endpoints_mutex;
+    server.register_callback_on_connect([&](netlib::client_endpoint endpoint) -> netlib::server_response {
+        std::lock_guard<std::mutex> lock(endpoints_mutex);
+        endpoints.push_back(endpoint);
+        return {};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+
+    for (int i = 0; i < 2; ++i) {
+        netlib::client client;
+        CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+        std::this_thread::sleep_for(100ms);
+        client.disconnect();
+        std::this_thread::sleep_for(100ms);
+    }
+    CHECK_EQ(server.get_client_count(), 0);
+    std::lock_guard<std::mutex> lock(endpoints_mutex);
+    CHECK_EQ(endpoints.size(), 2);
+    // the kernel hands out the lowest free descriptor, so the fd is usually the same
+    CHECK_NE(endpoints.front().id, endpoints.back().id);
+    CHECK_NE(endpoints.front(), endpoints.back());
+    // a handle to the old connection must not reach anyone
+    CHECK_FALSE(server.get_connection_stats(endpoints.front()).has_value());
+}
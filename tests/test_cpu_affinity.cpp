@@ -0,0 +1,57 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("CPU lists are parsed and resolved")
+{
+    CHECK((netlib::cpu_affinity::parse_cpu_list("0-3,8,10-11\n") == std::vector<std::size_t>{0, 1, 2, 3, 8, 10, 11}));
+    CHECK(netlib::cpu_affinity::parse_cpu_list("").empty());
+
+    const std::vector<std::size_t> online = netlib::cpu_affinity::get_online_cpus();
+    REQUIRE_FALSE(online.empty());
+    CHECK(netlib::cpu_affinity::resolve({}).first.empty());
+    CHECK_EQ(netlib::cpu_affinity::resolve({.mode = netlib::AffinityMode::cpu_list}).second, std::errc::invalid_argument);
+    CHECK_EQ(netlib::cpu_affinity::resolve({.mode = netlib::AffinityMode::cpu_list, .cpus = {100000}}).second,
+             std::errc::invalid_argument);
+    auto [listed, list_error] = netlib::cpu_affinity::resolve({.mode = netlib::AffinityMode::cpu_list, .cpus = {online.front()}});
+    CHECK_FALSE(list_error);
+    CHECK(listed == std::vector<std::size_t>{online.front()});
+#ifdef __linux__
+    auto [cores, core_error] = netlib::cpu_affinity::resolve({.mode = netlib::AffinityMode::physical_cores});
+    CHECK_FALSE(core_error);
+    CHECK_FALSE(cores.empty());
+    CHECK_LE(cores.size(), online.size());
+    CHECK_EQ(netlib::cpu_affinity::resolve({.mode = netlib::AffinityMode::nic_node, .interface = "no-such-nic0"}).second,
+             std::errc::no_such_device);
+    // loopback has no device, so every cpu is as close as any other
+    CHECK(netlib::cpu_affinity::resolve({.mode = netlib::AffinityMode::nic_node, .interface = "lo"}).first == online);
+#endif
+}
+
+#ifdef __linux__
+TEST_CASE("Pool workers and processing threads run on their configured cpu")
+{
+    const std::size_t cpu = netlib::cpu_affinity::get_online_cpus().back();
+    netlib::thread_pool pool({.start_threads = 2,
+                              .max_threads = 2,
+                              .affinity = {.mode = netlib::AffinityMode::cpu_list, .cpus = {cpu}}});
+    CHECK_EQ(pool.add_task([]() { return sched_getcpu(); }).get(), static_cast<int>(cpu));
+
+    netlib::server server;
+    CHECK_EQ(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP,
+                           {.reactor_affinity = {.mode = netlib::AffinityMode::cpu_list, .cpus = {100000}}}),
+             std::errc::invalid_argument);
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP,
+                              {.reactor_affinity = {.mode = netlib::AffinityMode::cpu_list, .cpus = {cpu}},
+                               .prefill_buffers = 8}));
+    // slabs are allocated by the pinned processing thread itself
+    auto start = std::chrono::steady_clock::now();
+    while ((server.get_shard_stats().front().receive_buffer_allocations < 8) && (std::chrono::steady_clock::now() - start < 5s)) {
+        std::this_thread::sleep_for(1ms);
+    }
+    CHECK_EQ(server.get_shard_stats().front().receive_buffer_allocations, 8);
+    server.stop();
+}
+#endif
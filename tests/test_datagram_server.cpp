@@ -0,0 +1,88 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Datagram server answers every datagram")
+{
+    constexpr std::size_t datagram_count = 200;
+    netlib::server server;
+    server.register_callback_on_datagram([&](const netlib::datagram_endpoint &source, std::span<const uint8_t> data) -> netlib::server_response {
+        std::vector<uint8_t> answer(data.begin(), data.end());
+        answer.push_back('!');
+        return {.answer = answer};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::UDP,
+                              {.datagram_batch_size = 16, .datagram_recv_buffer_size = 1024 * 1024}));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::UDP, 1000ms));
+    for (std::size_t i = 0; i < datagram_count; ++i) {
+        CHECK_FALSE(client.send(std::vector<uint8_t>{static_cast<uint8_t>(i), 0, 1}, 100ms).second);
+    }
+    // every datagram comes back as its own datagram, so a read never spans two answers
+    std::size_t answers = 0;
+    auto start = std::chrono::steady_clock::now();
+    while ((answers < datagram_count) && (std::chrono::steady_clock::now() - start < 5s)) {
+        auto recv_res = client.recv(4, 100ms);
+        if (recv_res.first.size() == 4) {
+            CHECK_EQ(recv_res.first.back(), '!');
+            answers++;
+        }
+    }
+    CHECK_EQ(answers, datagram_count);
+
+    std::vector<netlib::shard_stats> stats = server.get_shard_stats();
+    CHECK_EQ(stats.front().received_datagrams, datagram_count);
+    CHECK_EQ(stats.front().sent_datagrams, datagram_count);
+    CHECK_EQ(stats.front().dropped_datagrams, 0);
+    CHECK_EQ(server.get_client_count(), 0);
+    server.stop();
+}
+
+TEST_CASE("Datagram client sends and receives in batches")
+{
+    constexpr std::size_t datagram_count = 300;
+    std::atomic<std::size_t> received = 0;
+    netlib::server server;
+    server.register_callback_on_datagram([&](const netlib::datagram_endpoint &source, std::span<const uint8_t> data) -> netlib::server_response {
+        received++;
+        return {.answer = std::vector<uint8_t>(data.begin(), data.end())};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::UDP,
+                              {.datagram_recv_buffer_size = 4 * 1024 * 1024}));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::UDP, 1000ms));
+    client.get_socket()->set_recv_buffer_size(4 * 1024 * 1024);
+    client.set_gso(true);
+    // equally sized datagrams get coalesced with GSO, the odd one out ends a run
+    std::vector<std::vector<uint8_t>> datagrams;
+    for (std::size_t i = 0; i < datagram_count; ++i) {
+        datagrams.emplace_back((i % 100 == 99) ? 10 : 100, static_cast<uint8_t>(i));
+    }
+    auto send_res = client.send_batch(datagrams, 1000ms);
+    CHECK_FALSE(send_res.second);
+    CHECK_EQ(send_res.first, datagram_count);
+
+    std::vector<uint8_t> arena(datagram_count * 128);
+    std::vector<netlib::datagram_recv_slot> slots(datagram_count);
+    for (std::size_t i = 0; i < slots.size(); ++i) {
+        slots[i].buffer = std::span<uint8_t>(arena).subspan(i * 128, 128);
+    }
+    std::size_t answers = 0;
+    auto start = std::chrono::steady_clock::now();
+    while ((answers < datagram_count) && (std::chrono::steady_clock::now() - start < 5s)) {
+        auto recv_res = client.recv_batch(std::span<netlib::datagram_recv_slot>(slots).subspan(answers), 100ms);
+        answers += recv_res.first;
+    }
+    CHECK_EQ(answers, datagram_count);
+    CHECK_EQ(received, datagram_count);
+    for (std::size_t i = 0; i < answers; ++i) {
+        CHECK_EQ(slots[i].size, datagrams[i].size());
+        CHECK_EQ(slots[i].buffer[0], datagrams[i][0]);
+    }
+    server.stop();
+}
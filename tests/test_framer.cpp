@@ -0,0 +1,89 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <span>
+#include <string>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+static std::vector<std::string> feed_bytewise(netlib::frame_reader &reader, const std::vector<uint8_t> &data, std::error_condition &error)
+{
+    std::vector<std::string> frames;
+    for (uint8_t b : data) {
+        error = reader.feed(std::span<const uint8_t>(&b, 1), [&](std::span<const uint8_t> frame) {
+            frames.emplace_back(frame.begin(), frame.end());
+            return std::error_condition{};
+        });
+        if (error) {
+            break;
+        }
+    }
+    return frames;
+}
+
+TEST_CASE("Framers split byte streams into messages")
+{
+    std::error_condition error;
+    netlib::frame_reader length_reader(std::make_shared<netlib::length_prefix_framer>(2, netlib::ByteOrder::little));
+    auto frames = feed_bytewise(length_reader, {3, 0, 'a', 'b', 'c', 0, 0, 1, 0, 'd'}, error);
+    CHECK_FALSE(error);
+    CHECK(frames == std::vector<std::string>({"abc", "", "d"}));
+    CHECK_EQ(length_reader.get_pending_size(), 0);
+
+    netlib::frame_reader line_reader(std::make_shared<netlib::delimiter_framer>(std::vector<uint8_t>{'\r', '\n'}));
+    const std::string lines = "hello\r\nworld\r\npart";
+    frames = feed_bytewise(line_reader, {lines.begin(), lines.end()}, error);
+    CHECK_FALSE(error);
+    CHECK(frames == std::vector<std::string>({"hello", "world"}));
+    CHECK_EQ(line_reader.get_pending_size(), 4);
+
+    netlib::frame_reader fixed_reader(std::make_shared<netlib::fixed_size_framer>(2));
+    const std::vector<uint8_t> fixed = {'a', 'b', 'c', 'd', 'e'};
+    error = fixed_reader.feed(fixed, [&](std::span<const uint8_t> frame) {
+        CHECK_EQ(frame.size(), 2);
+        return std::error_condition{};
+    });
+    CHECK_FALSE(error);
+    CHECK_EQ(fixed_reader.get_pending_size(), 1);
+
+    netlib::frame_reader guarded_reader(std::make_shared<netlib::length_prefix_framer>(4, netlib::ByteOrder::big, false, 16));
+    feed_bytewise(guarded_reader, {0, 0, 1, 0}, error);
+    CHECK(error == std::errc::message_size);
+
+    netlib::frame_reader unterminated_reader(std::make_shared<netlib::delimiter_framer>(std::vector<uint8_t>{'\n'}, 8));
+    feed_bytewise(unterminated_reader, std::vector<uint8_t>(16, 'x'), error);
+    CHECK(error == std::errc::message_size);
+}
+
+TEST_CASE("Server and client exchange framed messages")
+{
+    auto message_framer = std::make_shared<netlib::length_prefix_framer>();
+    std::atomic<std::size_t> received_frames = 0;
+    netlib::server server;
+    server.set_framer(message_framer);
+    server.register_callback_on_recv_span([&](netlib::client_endpoint endpoint, std::span<const uint8_t> frame) -> netlib::server_response {
+        received_frames++;
+        // echo the frame back including its header
+        std::vector<uint8_t> answer = {0, 0, 0, static_cast<uint8_t>(frame.size())};
+        answer.insert(answer.end(), frame.begin(), frame.end());
+        return {.answer = answer};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+
+    netlib::client client;
+    client.set_framer(message_framer);
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    // two messages in one send, then one split over two sends
+    CHECK_FALSE(client.send(std::vector<uint8_t>{0, 0, 0, 2, 'h', 'i', 0, 0, 0, 1, '!'}, 100ms).second);
+    CHECK_FALSE(client.send(std::vector<uint8_t>{0, 0, 0, 3, 'a'}, 100ms).second);
+    std::this_thread::sleep_for(50ms);
+    CHECK_FALSE(client.send(std::vector<uint8_t>{'b', 'c'}, 100ms).second);
+
+    for (const std::string expected : {"hi", "!", "abc"}) {
+        auto recv_res = client.recv_frame(1000ms);
+        CHECK_FALSE(recv_res.second);
+        CHECK_EQ(std::string(recv_res.first.begin(), recv_res.first.end()), expected);
+    }
+    CHECK_EQ(received_frames, 3);
+    server.stop();
+}
@@ -0,0 +1,74 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+static netlib::server_response answer_with(uint8_t tag)
+{
+    return {.answer = {tag}};
+}
+
+TEST_CASE("Listeners are handed to a successor without refusing connections")
+{
+    netlib::server predecessor;
+    predecessor.register_callback_on_recv([](netlib::client_endpoint endpoint, std::vector<uint8_t> data) {
+        return answer_with('a');
+    });
+    CHECK_FALSE(predecessor.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+    netlib::client old_client;
+    CHECK_FALSE(old_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    std::this_thread::sleep_for(100ms);
+
+    int32_t channel_fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, channel_fds) == 0);
+    netlib::socket sending_end;
+    netlib::socket receiving_end;
+    sending_end.set_raw(channel_fds[0]);
+    receiving_end.set_raw(channel_fds[1]);
+    std::vector<socket_t> listeners = predecessor.get_listeners();
+    CHECK_EQ(listeners.size(), 1);
+    CHECK_FALSE(netlib::listener_handoff::send(sending_end, listeners));
+    auto [received, receive_error] = netlib::listener_handoff::receive(receiving_end, 1000ms);
+    CHECK_FALSE(receive_error);
+    CHECK_EQ(received.size(), 1);
+    // a successor exec'ing again must not leak them
+    for (socket_t fd : received) {
+        CHECK((::fcntl(fd, F_GETFD) & FD_CLOEXEC));
+    }
+    sending_end.close();
+    receiving_end.close();
+
+    netlib::server successor;
+    successor.register_callback_on_recv([](netlib::client_endpoint endpoint, std::vector<uint8_t> data) {
+        return answer_with('b');
+    });
+    CHECK_FALSE(successor.adopt(received));
+    predecessor.stop_accepting();
+
+    netlib::client new_client;
+    CHECK_FALSE(new_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    CHECK_FALSE(new_client.send(std::vector<uint8_t>{1}, 100ms).second);
+    CHECK_EQ(new_client.recv(1, 1000ms).first, std::vector<uint8_t>{'b'});
+    // established connections stay with the predecessor until it stops
+    CHECK_FALSE(old_client.send(std::vector<uint8_t>{1}, 100ms).second);
+    CHECK_EQ(old_client.recv(1, 1000ms).first, std::vector<uint8_t>{'a'});
+
+    predecessor.stop();
+    netlib::client late_client;
+    CHECK_FALSE(late_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    CHECK_FALSE(late_client.send(std::vector<uint8_t>{1}, 100ms).second);
+    CHECK_EQ(late_client.recv(1, 1000ms).first, std::vector<uint8_t>{'b'});
+    successor.stop();
+}
+
+TEST_CASE("Only listening or datagram sockets can be adopted")
+{
+    netlib::socket unbound;
+    CHECK_FALSE(unbound.create(AF_INET, SOCK_STREAM, 0));
+    netlib::server server;
+    const std::vector<socket_t> listeners{unbound.get_raw().value()};
+    CHECK_EQ(server.adopt(listeners), std::errc::invalid_argument);
+    CHECK_EQ(server.adopt({}), std::errc::invalid_argument);
+    unbound.close();
+}
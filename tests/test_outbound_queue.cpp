@@ -0,0 +1,79 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Slow consumer does not stall send_data")
+{
+    std::vector<uint8_t> large_data_buffer(8 * 1024 * 1024, 0);
+    uint8_t overflow_counter = 0;
+    std::for_each(large_data_buffer.begin(), large_data_buffer.end(), [&](uint8_t &b) {
+        b = overflow_counter++;
+    });
+
+    netlib::server server;
+    std::error_condition server_create_res =
+        server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP);
+    CHECK_FALSE(server_create_res);
+
+    // the slow client never reads, so its socket buffers fill up quickly
+    netlib::client slow_client;
+    netlib::client fast_client;
+    CHECK_FALSE(slow_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    CHECK_FALSE(fast_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    std::this_thread::sleep_for(100ms);
+    CHECK_EQ(server.get_client_count(), 2);
+
+    auto start = std::chrono::steady_clock::now();
+    CHECK_FALSE(server.send_data(large_data_buffer, {}));
+    CHECK_LT(std::chrono::steady_clock::now() - start, 500ms);
+
+    auto recv_res = fast_client.recv(large_data_buffer.size(), 5000ms);
+    CHECK_FALSE(recv_res.second);
+    CHECK(recv_res.first == large_data_buffer);
+}
+
+TEST_CASE("Broadcast shares one buffer and reports completion")
+{
+    std::vector<uint8_t> large_data_buffer(8 * 1024 * 1024, 0);
+    uint8_t overflow_counter = 0;
+    std::for_each(large_data_buffer.begin(), large_data_buffer.end(), [&](uint8_t &b) {
+        b = overflow_counter++;
+    });
+
+    netlib::server server;
+    std::error_condition server_create_res =
+        server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP);
+    CHECK_FALSE(server_create_res);
+
+    netlib::client reading_client;
+    netlib::client leaving_client;
+    CHECK_FALSE(reading_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    CHECK_FALSE(leaving_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    std::this_thread::sleep_for(100ms);
+
+    std::atomic<bool> completed = false;
+    std::atomic<std::size_t> delivered = 0;
+    std::atomic<std::size_t> dropped = 0;
+    CHECK_FALSE(server.broadcast(netlib::shared_buffer::create(large_data_buffer, [&](std::size_t delivered_count, std::size_t dropped_count) {
+        delivered = delivered_count;
+        dropped = dropped_count;
+        completed = true;
+    })));
+
+    // one client takes everything, the other one leaves without reading
+    auto recv_res = reading_client.recv(large_data_buffer.size(), 5000ms);
+    CHECK_FALSE(recv_res.second);
+    CHECK(recv_res.first == large_data_buffer);
+    CHECK_FALSE(leaving_client.disconnect());
+
+    auto start = std::chrono::steady_clock::now();
+    while (!completed && (std::chrono::steady_clock::now() - start < 5s)) {
+        std::this_thread::sleep_for(1ms);
+    }
+    CHECK(completed);
+    CHECK_EQ(delivered, 1);
+    CHECK_EQ(dropped, 1);
+}
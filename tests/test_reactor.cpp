@@ -0,0 +1,94 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+static const std::vector<netlib::ReactorBackend> reactor_backends = {netlib::ReactorBackend::automatic, netlib::ReactorBackend::poll,
+                                                                     netlib::ReactorBackend::select};
+
+TEST_CASE("Reactor wakeup interrupts wait")
+{
+    for (netlib::ReactorBackend backend : reactor_backends) {
+        auto [reactor, reactor_error] = netlib::reactor::create(backend);
+        REQUIRE_FALSE(reactor_error);
+        std::vector<netlib::reactor_event> events;
+        auto start = std::chrono::steady_clock::now();
+        std::thread waker([&]() {
+            std::this_thread::sleep_for(50ms);
+            reactor->wakeup();
+        });
+        CHECK_FALSE(reactor->wait(events, 5000ms));
+        waker.join();
+        CHECK(events.empty());
+        CHECK_LT(std::chrono::steady_clock::now() - start, 1000ms);
+    }
+}
+
+#ifdef __linux__
+TEST_CASE("Reactors report running out of descriptors")
+{
+    const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in loopback{};
+    loopback.sin_family = AF_INET;
+    loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE_EQ(::bind(listener, reinterpret_cast<sockaddr *>(&loopback), sizeof(loopback)), 0);
+    REQUIRE_EQ(::listen(listener, 16), 0);
+    // every descriptor below a lowered limit gets used up, so the reactor can't get any
+    rlimit original{};
+    REQUIRE_EQ(::getrlimit(RLIMIT_NOFILE, &original), 0);
+    rlimit lowered = original;
+    lowered.rlim_cur = 256;
+    REQUIRE_EQ(::setrlimit(RLIMIT_NOFILE, &lowered), 0);
+    std::vector<int> fillers;
+    for (int fd = ::dup(0); fd >= 0; fd = ::dup(0)) {
+        fillers.push_back(fd);
+    }
+    for (netlib::ReactorBackend backend : reactor_backends) {
+        auto [reactor, reactor_error] = netlib::reactor::create(backend);
+        CHECK_EQ(reactor_error, std::errc::too_many_files_open);
+        CHECK_FALSE(reactor);
+    }
+    // the server passes the error on instead of running without a reactor
+    netlib::server server;
+    const std::vector<socket_t> listeners = {listener};
+    std::error_condition server_error = server.adopt(listeners);
+    for (int fd : fillers) {
+        ::close(fd);
+    }
+    ::setrlimit(RLIMIT_NOFILE, &original);
+    CHECK_EQ(server_error, std::errc::too_many_files_open);
+    CHECK_EQ(server.get_listeners().size(), 0);
+    ::close(listener);
+}
+#endif
+
+TEST_CASE("Server echo on every reactor backend")
+{
+    static const std::vector<uint8_t> payload = {4, 5, 6, 7};
+    for (netlib::ReactorBackend backend : reactor_backends) {
+        netlib::server server;
+        server.register_callback_on_recv([&](netlib::client_endpoint endpoint, const std::vector<uint8_t> &data) -> netlib::server_response {
+            return {.answer = data};
+        });
+        std::error_condition server_create_res = server.create("localhost", test_port, netlib::AddressFamily::IPv4,
+                                                               netlib::AddressProtocol::TCP, {.reactor_backend = backend});
+        CHECK_FALSE(server_create_res);
+
+        netlib::client client;
+        CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+        // several round trips, so the registration has to be re-armed in between
+        for (int i = 0; i < 3; ++i) {
+            auto send_res = client.send(payload, 100ms);
+            CHECK_FALSE(send_res.second);
+            auto recv_res = client.recv(payload.size(), 1000ms);
+            CHECK_FALSE(recv_res.second);
+            CHECK(recv_res.first == payload);
+        }
+    }
+}
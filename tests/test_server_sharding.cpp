@@ -0,0 +1,52 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <numeric>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Server with SO_REUSEPORT shards")
+{
+    static constexpr std::size_t SHARD_COUNT = 4;
+    static constexpr std::size_t CLIENT_COUNT = 32;
+    static const std::vector<uint8_t> payload = {1, 3, 3, 7};
+
+    netlib::server server;
+    server.register_callback_on_recv([&](netlib::client_endpoint endpoint, const std::vector<uint8_t> &data) -> netlib::server_response {
+        return {.answer = data};
+    });
+
+    std::error_condition server_create_res =
+        server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP,
+                      {.reuseport_sharding = true, .shard_count = SHARD_COUNT});
+    CHECK_FALSE(server_create_res);
+
+    std::vector<netlib::client> clients(CLIENT_COUNT);
+    for (auto &client : clients) {
+        CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    }
+    std::this_thread::sleep_for(250ms);
+    CHECK_EQ(server.get_client_count(), CLIENT_COUNT);
+
+    for (auto &client : clients) {
+        CHECK_FALSE(client.send(payload, 100ms).second);
+        auto recv_res = client.recv(payload.size(), 1000ms);
+        CHECK_FALSE(recv_res.second);
+        CHECK(recv_res.first == payload);
+    }
+
+    std::vector<netlib::shard_stats> stats = server.get_shard_stats();
+    std::size_t accepted = std::accumulate(stats.begin(), stats.end(), std::size_t{0}, [](std::size_t sum, const netlib::shard_stats &s) {
+        return sum + s.accepted_connections;
+    });
+    CHECK_EQ(accepted, CLIENT_COUNT);
+#ifdef __linux__
+    // linux hashes connections across the listeners, so more than one shard has to be busy
+    CHECK_EQ(stats.size(), SHARD_COUNT);
+    CHECK_GT(std::count_if(stats.begin(), stats.end(),
+                           [](const netlib::shard_stats &s) {
+                               return s.accepted_connections > 0;
+                           }),
+             1);
+#endif
+}
@@ -0,0 +1,98 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+#include <memory>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Clients and a server share one thread pool")
+{
+    constexpr std::size_t client_count = 64;
+    auto executor = std::make_shared<netlib::thread_pool>(netlib::thread_pool_config{.start_threads = 1, .max_threads = 2});
+    netlib::server server;
+    server.register_callback_on_recv([](netlib::client_endpoint endpoint, std::vector<uint8_t> data) -> netlib::server_response {
+        return {.answer = data};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP,
+                              {.executor = executor}));
+
+    std::vector<std::unique_ptr<netlib::client>> clients;
+    std::vector<std::future<std::error_condition>> connects;
+    for (std::size_t i = 0; i < client_count; ++i) {
+        clients.push_back(std::make_unique<netlib::client>(executor));
+        connects.push_back(clients.back()->connect_async("localhost", test_port, netlib::AddressFamily::IPv4,
+                                                         netlib::AddressProtocol::TCP, 1000ms));
+    }
+    std::size_t failed = 0;
+    for (auto &connect : connects) {
+        failed += connect.get() ? 1 : 0;
+    }
+    CHECK_EQ(failed, 0);
+    for (std::size_t i = 0; i < client_count; ++i) {
+        std::vector<uint8_t> data = {static_cast<uint8_t>(i), 1, 2, 3};
+        CHECK_EQ(clients[i]->send_async(data).get().first, data.size());
+        auto [answer, recv_error] = clients[i]->recv(data.size(), 1000ms);
+        CHECK_FALSE(recv_error);
+        CHECK(answer == data);
+    }
+    // all of them together never got more than the threads of the shared pool
+    CHECK_LE(executor->get_thread_count(), 2);
+    clients.clear();
+    server.stop();
+}
+
+TEST_CASE("Clients without a pool of their own use the default one")
+{
+    CHECK_EQ(netlib::thread_pool::get_default(), netlib::thread_pool::get_default());
+    std::future<std::pair<std::vector<uint8_t>, std::error_condition>> pending;
+    {
+        netlib::client client;
+        // nobody listens, the operation fails on its own
+        pending = client.recv_async(1, 100ms);
+        // the destructor waits for the operation, which uses the client
+    }
+    REQUIRE_EQ(pending.wait_for(0ms), std::future_status::ready);
+    CHECK_EQ(pending.get().second, std::errc::not_connected);
+}
+
+TEST_CASE("A blocked client doesn't hold up the others on the default pool")
+{
+    netlib::server server;
+    server.register_callback_on_recv([](netlib::client_endpoint, std::vector<uint8_t>) -> netlib::server_response {
+        return {};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+    {
+        netlib::client waiting;
+        CHECK_FALSE(waiting.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+        // the server never answers, so this occupies a pool thread for the whole timeout
+        auto pending = waiting.recv_async(10, 2000ms);
+        std::this_thread::sleep_for(20ms);
+
+        netlib::client other;
+        auto start = std::chrono::steady_clock::now();
+        auto connect = other.connect_async("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms);
+        REQUIRE_EQ(connect.wait_for(1000ms), std::future_status::ready);
+        CHECK_FALSE(connect.get());
+        CHECK_LT(std::chrono::steady_clock::now() - start, 500ms);
+        CHECK_EQ(pending.wait_for(0ms), std::future_status::timeout);
+    }
+    server.stop();
+}
+
+TEST_CASE("Servers refuse a pool which may reject their tasks")
+{
+    auto rejecting = std::make_shared<netlib::thread_pool>(
+        netlib::thread_pool_config{.queue_capacity = 4, .queue_full_policy = netlib::QueueFullPolicy::reject});
+    netlib::server server;
+    // a dropped task would leave its connection hanging without any error
+    CHECK_EQ(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, {.executor = rejecting}),
+             std::errc::invalid_argument);
+    CHECK_EQ(server.get_listeners().size(), 0);
+
+    // waiting or running the task inline keeps every task
+    auto blocking = std::make_shared<netlib::thread_pool>(netlib::thread_pool_config{.queue_capacity = 4});
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, {.executor = blocking}));
+    server.stop();
+}
@@ -0,0 +1,59 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+#include <span>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Span callback answers with referenced segments")
+{
+    static const std::vector<uint8_t> header = {'o', 'k', ':'};
+    std::atomic<std::size_t> header_delivered = 0;
+    netlib::server server;
+    server.register_callback_on_recv_span([&](netlib::client_endpoint endpoint, std::span<const uint8_t> data) -> netlib::server_response {
+        // the header is caller owned, the echoed part has to be copied since the span dies with the callback
+        return {.segments = {netlib::shared_buffer::reference(header,
+                                                              [&](std::size_t delivered, std::size_t dropped) {
+                                                                  header_delivered += delivered;
+                                                              }),
+                             netlib::shared_buffer::create(std::vector<uint8_t>(data.begin(), data.end()))}};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    const std::array<uint8_t, 4> payload = {1, 2, 3, 4};
+    auto send_res = client.send(std::span<const uint8_t>(payload), 100ms);
+    CHECK_FALSE(send_res.second);
+    CHECK_EQ(send_res.first, payload.size());
+
+    auto recv_res = client.recv(header.size() + payload.size(), 1000ms);
+    CHECK_FALSE(recv_res.second);
+    CHECK(recv_res.first == std::vector<uint8_t>({'o', 'k', ':', 1, 2, 3, 4}));
+    // the last reference may be dropped a bit after the data went out
+    auto start = std::chrono::steady_clock::now();
+    while ((header_delivered == 0) && (std::chrono::steady_clock::now() - start < 1s)) {
+        std::this_thread::sleep_for(1ms);
+    }
+    CHECK_EQ(header_delivered, 1);
+    server.stop();
+}
+
+TEST_CASE("Pooled buffer can be echoed without copying")
+{
+    netlib::server server;
+    server.register_callback_on_recv_buffer([&](netlib::client_endpoint endpoint, netlib::pooled_buffer data) -> netlib::server_response {
+        return {.segments = {netlib::shared_buffer::create(std::move(data))}};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    const std::vector<uint8_t> payload(1000, 0x17);
+    CHECK_FALSE(client.send(payload, 100ms).second);
+    auto recv_res = client.recv(payload.size(), 1000ms);
+    CHECK_FALSE(recv_res.second);
+    CHECK(recv_res.first == payload);
+    server.stop();
+}
@@ -0,0 +1,99 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Busy connections are read in order within the read budget")
+{
+    constexpr std::size_t stream_size = 4 * 1024 * 1024;
+    std::atomic<std::size_t> received = 0;
+    std::atomic<std::size_t> running_callbacks = 0;
+    std::atomic<bool> overlapped = false;
+    std::atomic<bool> out_of_order = false;
+
+    netlib::server server;
+    server.register_callback_on_recv_span([&](netlib::client_endpoint endpoint, std::span<const uint8_t> data) -> netlib::server_response {
+        if (running_callbacks++) {
+            overlapped = true;
+        }
+        for (uint8_t byte : data) {
+            if (byte != static_cast<uint8_t>(received++)) {
+                out_of_order = true;
+            }
+        }
+        running_callbacks--;
+        return {};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, {.read_budget = 16 * 1024}));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    std::vector<uint8_t> stream(stream_size);
+    for (std::size_t i = 0; i < stream.size(); ++i) {
+        stream[i] = static_cast<uint8_t>(i);
+    }
+    CHECK_FALSE(client.send(stream, 5000ms).second);
+    auto start = std::chrono::steady_clock::now();
+    while ((received < stream_size) && (std::chrono::steady_clock::now() - start < 5s)) {
+        std::this_thread::sleep_for(10ms);
+    }
+    CHECK_EQ(received, stream_size);
+    CHECK_FALSE(overlapped);
+    CHECK_FALSE(out_of_order);
+    // readable connections of one wakeup share pool tasks
+    std::vector<netlib::shard_stats> stats = server.get_shard_stats();
+    CHECK_GT(stats.front().dispatched_events, 0);
+    CHECK_LE(stats.front().dispatch_tasks, stats.front().dispatched_events);
+    server.stop();
+}
+
+TEST_CASE("Tasks posted to a connection run in order after its callback")
+{
+    constexpr std::size_t task_count = 100;
+    std::mutex order_mutex;
+    std::vector<std::size_t> order;
+    std::atomic<bool> in_callback = false;
+    std::atomic<bool> overlapped = false;
+    netlib::server *server_ptr = nullptr;
+
+    netlib::server server;
+    server_ptr = &server;
+    server.register_callback_on_recv([&](netlib::client_endpoint endpoint, std::vector<uint8_t> data) -> netlib::server_response {
+        in_callback = true;
+        for (std::size_t i = 0; i < task_count; ++i) {
+            server_ptr->post(endpoint, [&, i]() {
+                overlapped = overlapped || in_callback;
+                std::lock_guard<std::mutex> lock(order_mutex);
+                order.push_back(i);
+            });
+        }
+        std::this_thread::sleep_for(50ms);
+        in_callback = false;
+        return {.answer = {1}};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    CHECK_FALSE(client.send(std::vector<uint8_t>{1}, 100ms).second);
+    CHECK_EQ(client.recv(1, 1000ms).first.size(), 1);
+    std::this_thread::sleep_for(100ms);
+    {
+        std::lock_guard<std::mutex> lock(order_mutex);
+        REQUIRE_EQ(order.size(), task_count);
+        for (std::size_t i = 0; i < task_count; ++i) {
+            CHECK_EQ(order[i], i);
+        }
+    }
+    CHECK_FALSE(overlapped);
+    // the connection still works after its tasks ran
+    CHECK_FALSE(client.send(std::vector<uint8_t>{1}, 100ms).second);
+    CHECK_EQ(client.recv(1, 1000ms).first.size(), 1);
+
+    netlib::client_endpoint unknown;
+    unknown.id = 0;
+    CHECK_EQ(server.post(unknown, []() {}), std::errc::not_connected);
+    server.stop();
+}
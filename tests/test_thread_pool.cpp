@@ -0,0 +1,385 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Work stealing deque hands out every item exactly once")
+{
+    constexpr std::size_t item_count = 100000;
+    netlib::work_stealing_deque<std::size_t> deque(4);
+    std::vector<std::size_t> items(item_count);
+    std::vector<std::atomic<std::size_t>> seen(item_count);
+    std::atomic<bool> done = false;
+
+    // owner end is LIFO, thieves take the oldest item
+    deque.push(&items[0]);
+    deque.push(&items[1]);
+    CHECK_EQ(deque.steal(), &items[0]);
+    CHECK_EQ(deque.pop(), &items[1]);
+    CHECK_EQ(deque.pop(), nullptr);
+
+    std::vector<std::thread> thieves;
+    for (int t = 0; t < 3; ++t) {
+        thieves.emplace_back([&]() {
+            while (!done || !deque.empty()) {
+                if (std::size_t *item = deque.steal()) {
+                    seen[item - items.data()]++;
+                }
+            }
+        });
+    }
+    for (std::size_t i = 0; i < item_count; ++i) {
+        deque.push(&items[i]);
+        if ((i % 3 == 0)) {
+            if (std::size_t *item = deque.pop()) {
+                seen[item - items.data()]++;
+            }
+        }
+    }
+    while (std::size_t *item = deque.pop()) {
+        seen[item - items.data()]++;
+    }
+    done = true;
+    for (auto &thief : thieves) {
+        thief.join();
+    }
+    std::size_t wrong = 0;
+    for (auto &count : seen) {
+        wrong += (count != 1) ? 1 : 0;
+    }
+    CHECK_EQ(wrong, 0);
+}
+
+TEST_CASE("Thread pool runs tasks submitted from inside its workers")
+{
+    for (netlib::PoolScheduling scheduling : {netlib::PoolScheduling::work_stealing, netlib::PoolScheduling::shared_queue}) {
+        netlib::thread_pool pool({.start_threads = 4, .max_threads = 4, .scheduling = scheduling});
+        constexpr std::size_t fan_out = 200;
+        std::atomic<std::size_t> finished = 0;
+        std::mutex ids_mutex;
+        std::set<std::thread::id> ids;
+        std::vector<std::future<void>> roots;
+        for (std::size_t i = 0; i < 8; ++i) {
+            roots.push_back(pool.add_task([&]() {
+                for (std::size_t j = 0; j < fan_out; ++j) {
+                    pool.add_task([&]() {
+                        std::this_thread::sleep_for(100us);
+                        std::lock_guard<std::mutex> lock(ids_mutex);
+                        ids.insert(std::this_thread::get_id());
+                        finished++;
+                    });
+                }
+            }));
+        }
+        for (auto &root : roots) {
+            root.wait();
+        }
+        auto start = std::chrono::steady_clock::now();
+        while ((finished < 8 * fan_out) && (std::chrono::steady_clock::now() - start < 5s)) {
+            std::this_thread::sleep_for(1ms);
+        }
+        CHECK_EQ(finished, 8 * fan_out);
+        // the subtasks were spread over the pool, not only run by the worker that queued them
+        CHECK_GT(ids.size(), 1);
+        CHECK_EQ(pool.get_task_count(), 0);
+    }
+}
+
+TEST_CASE("Thread pool returns results through futures")
+{
+    netlib::thread_pool pool;
+    std::vector<std::future<std::size_t>> results;
+    for (std::size_t i = 0; i < 1000; ++i) {
+        results.push_back(pool.add_task([](std::size_t value) { return value * 2; }, i));
+    }
+    std::size_t wrong = 0;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        wrong += (results[i].get() != i * 2) ? 1 : 0;
+    }
+    CHECK_EQ(wrong, 0);
+    CHECK_LE(pool.get_thread_count(), pool.get_max_thread_count());
+}
+
+TEST_CASE("Unique task stores small callables inline and accepts move-only ones")
+{
+    auto owned = std::make_unique<int>(41);
+    int result = 0;
+    netlib::unique_task task([&result, owned = std::move(owned)]() { result = *owned + 1; });
+    netlib::unique_task moved(std::move(task));
+    CHECK_FALSE(static_cast<bool>(task));
+    moved();
+    CHECK_EQ(result, 42);
+
+    std::array<char, 2 * netlib::unique_task::INLINE_SIZE> large{};
+    large[0] = 7;
+    auto large_callable = [&result, large]() { result = large[0]; };
+    CHECK(netlib::unique_task::fits_inline<decltype([&result]() { result = 0; })>);
+    CHECK_FALSE(netlib::unique_task::fits_inline<decltype(large_callable)>);
+    netlib::unique_task heap_task(large_callable);
+    moved = std::move(heap_task);
+    moved();
+    CHECK_EQ(result, 7);
+}
+
+TEST_CASE("Block pool recycles the shared state of futures")
+{
+    auto pool = netlib::block_pool::create(256, 16);
+    for (std::size_t i = 0; i < 100; ++i) {
+        std::promise<std::size_t> promise(std::allocator_arg, netlib::pooled_allocator<std::byte>(pool));
+        auto future = promise.get_future();
+        promise.set_value(i);
+        CHECK_EQ(future.get(), i);
+    }
+    // the state and the result storage
+    CHECK_LE(pool->get_allocation_count(), 2);
+    CHECK_EQ(pool->get_cached_count(), pool->get_allocation_count());
+
+    // too big to pool
+    void *block = pool->allocate(1024, alignof(std::max_align_t));
+    pool->deallocate(block, 1024, alignof(std::max_align_t));
+    CHECK_LE(pool->get_allocation_count(), 2);
+}
+
+TEST_CASE("Thread pool runs posted tasks and reports exceptions through futures")
+{
+    netlib::thread_pool pool({.start_threads = 2, .max_threads = 2});
+    std::atomic<std::size_t> sum = 0;
+    for (std::size_t i = 1; i <= 1000; ++i) {
+        pool.post([&sum](std::size_t value) { sum += value; }, i);
+    }
+    // throwing from a posted task must not take the worker down
+    pool.post([]() { throw std::runtime_error("dropped"); });
+    auto failing = pool.add_task([]() -> int { throw std::runtime_error("reported"); });
+    CHECK_THROWS_AS(failing.get(), std::runtime_error);
+    auto start = std::chrono::steady_clock::now();
+    while ((sum < 500500) && (std::chrono::steady_clock::now() - start < 5s)) {
+        std::this_thread::sleep_for(1ms);
+    }
+    CHECK_EQ(sum, 500500);
+    CHECK_EQ(pool.add_task([]() { return 1; }).get(), 1);
+}
+
+TEST_CASE("MPMC queue hands out every item exactly once")
+{
+    constexpr std::size_t per_producer = 50000;
+    netlib::mpmc_queue<std::size_t> queue(64);
+    CHECK_EQ(queue.capacity(), 64);
+    std::vector<std::atomic<std::size_t>> seen(4 * per_producer);
+    std::atomic<std::size_t> consumed = 0;
+    std::vector<std::thread> threads;
+    for (std::size_t p = 0; p < 4; ++p) {
+        threads.emplace_back([&, p]() {
+            for (std::size_t i = 0; i < per_producer; ++i) {
+                std::size_t value = p * per_producer + i;
+                while (!queue.try_push(std::move(value))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        threads.emplace_back([&]() {
+            std::size_t value = 0;
+            while (consumed < 4 * per_producer) {
+                if (queue.try_pop(value)) {
+                    seen[value]++;
+                    consumed++;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    std::size_t wrong = 0;
+    for (auto &count : seen) {
+        wrong += (count != 1) ? 1 : 0;
+    }
+    CHECK_EQ(wrong, 0);
+}
+
+TEST_CASE("Thread pool applies the queue full policy of a bounded queue")
+{
+    for (netlib::QueueFullPolicy policy :
+         {netlib::QueueFullPolicy::reject, netlib::QueueFullPolicy::run_inline, netlib::QueueFullPolicy::block}) {
+        netlib::thread_pool pool(
+            {.start_threads = 1, .max_threads = 1, .queue_capacity = 2, .queue_full_policy = policy});
+        std::promise<void> gate;
+        std::shared_future<void> gate_future = gate.get_future().share();
+        std::atomic<bool> started = false;
+        std::atomic<std::size_t> ran = 0;
+        // occupies the only worker, so the queue fills up
+        CHECK_FALSE(pool.post([&]() {
+            started = true;
+            gate_future.wait();
+            ran++;
+        }));
+        while (!started) {
+            std::this_thread::sleep_for(1ms);
+        }
+        CHECK_FALSE(pool.post([&]() { ran++; }));
+        CHECK_FALSE(pool.post([&]() { ran++; }));
+        CHECK_EQ(pool.get_task_count(), 2);
+
+        std::thread::id ran_on;
+        auto submit_full = [&]() {
+            return pool.post([&]() {
+                ran_on = std::this_thread::get_id();
+                ran++;
+            });
+        };
+        if (policy == netlib::QueueFullPolicy::reject) {
+            CHECK_EQ(submit_full(), std::errc::resource_unavailable_try_again);
+            auto future = pool.add_task([]() { return 1; });
+            gate.set_value();
+            CHECK_THROWS_AS(future.get(), std::future_error);
+        } else if (policy == netlib::QueueFullPolicy::run_inline) {
+            CHECK_FALSE(submit_full());
+            CHECK_EQ(ran_on, std::this_thread::get_id());
+            gate.set_value();
+        } else {
+            std::atomic<bool> submitted = false;
+            std::thread submitter([&]() {
+                CHECK_FALSE(submit_full());
+                submitted = true;
+            });
+            std::this_thread::sleep_for(50ms);
+            CHECK_FALSE(submitted);
+            gate.set_value();
+            submitter.join();
+            CHECK(submitted);
+        }
+        const std::size_t expected = (policy == netlib::QueueFullPolicy::reject) ? 3 : 4;
+        auto start = std::chrono::steady_clock::now();
+        while ((ran < expected) && (std::chrono::steady_clock::now() - start < 5s)) {
+            std::this_thread::sleep_for(1ms);
+        }
+        CHECK_EQ(ran, expected);
+    }
+}
+
+TEST_CASE("Thread pool grows while tasks wait and retires idle threads")
+{
+    netlib::thread_pool pool({.start_threads = 1,
+                              .min_threads = 1,
+                              .max_threads = 4,
+                              .keep_alive = 50ms,
+                              .max_queue_delay = 1ms});
+    CHECK_EQ(pool.get_thread_count(), 1);
+    std::atomic<std::size_t> finished = 0;
+    // submitted from several threads at once, growth must still respect the max
+    std::vector<std::thread> submitters;
+    for (int t = 0; t < 4; ++t) {
+        submitters.emplace_back([&]() {
+            for (int i = 0; i < 4; ++i) {
+                pool.post([&]() {
+                    std::this_thread::sleep_for(20ms);
+                    finished++;
+                });
+                std::this_thread::sleep_for(2ms);
+            }
+        });
+    }
+    for (auto &submitter : submitters) {
+        submitter.join();
+    }
+    CHECK_GT(pool.get_thread_count(), 1);
+    CHECK_LE(pool.get_thread_count(), 4);
+    auto start = std::chrono::steady_clock::now();
+    while ((finished < 16) && (std::chrono::steady_clock::now() - start < 5s)) {
+        std::this_thread::sleep_for(1ms);
+    }
+    CHECK_EQ(finished, 16);
+    // idle workers give up after the keep alive, down to the warm pool
+    start = std::chrono::steady_clock::now();
+    while ((pool.get_thread_count() > 1) && (std::chrono::steady_clock::now() - start < 5s)) {
+        std::this_thread::sleep_for(10ms);
+    }
+    CHECK_EQ(pool.get_thread_count(), 1);
+    // retired slots are reused
+    CHECK_EQ(pool.add_task([]() { return 2; }).get(), 2);
+    for (int i = 0; i < 8; ++i) {
+        pool.post([]() { std::this_thread::sleep_for(10ms); });
+    }
+    std::this_thread::sleep_for(30ms);
+    CHECK_GT(pool.get_thread_count(), 1);
+}
+
+TEST_CASE("Thread pool starts a thread for a task stuck behind a busy worker")
+{
+    netlib::thread_pool pool({.start_threads = 1, .max_threads = 2, .max_queue_delay = 2ms});
+    std::promise<void> gate;
+    std::shared_future<void> gate_future = gate.get_future().share();
+    std::atomic<bool> started = false;
+    pool.post([&]() {
+        started = true;
+        gate_future.wait_for(5s);
+    });
+    while (!started) {
+        std::this_thread::sleep_for(1ms);
+    }
+    // nothing else is submitted and nothing picked up, only the watchdog notices the wait
+    auto start = std::chrono::steady_clock::now();
+    auto short_task = pool.add_task([]() { return std::chrono::steady_clock::now(); });
+    REQUIRE_EQ(short_task.wait_for(1s), std::future_status::ready);
+    CHECK_LT(short_task.get() - start, 100ms);
+    CHECK_EQ(pool.get_thread_count(), 2);
+    gate.set_value();
+}
+
+TEST_CASE("Thread pool serves priority lanes in order without starving the low lane")
+{
+    for (std::size_t interval : {std::size_t{0}, std::size_t{4}}) {
+        netlib::thread_pool pool({.start_threads = 1, .max_threads = 1, .starvation_interval = interval});
+        std::promise<void> gate;
+        std::shared_future<void> gate_future = gate.get_future().share();
+        std::atomic<bool> started = false;
+        // occupies the only worker, so every lane fills up
+        pool.post([&]() {
+            started = true;
+            gate_future.wait();
+        });
+        while (!started) {
+            std::this_thread::sleep_for(1ms);
+        }
+        std::mutex order_mutex;
+        std::vector<netlib::TaskPriority> order;
+        for (netlib::TaskPriority priority : {netlib::TaskPriority::low, netlib::TaskPriority::normal, netlib::TaskPriority::high}) {
+            for (int i = 0; i < 8; ++i) {
+                CHECK_FALSE(pool.post(priority, [&, priority]() {
+                    std::lock_guard<std::mutex> lock(order_mutex);
+                    order.push_back(priority);
+                }));
+            }
+        }
+        auto last = pool.add_task(netlib::TaskPriority::low, []() { return 3; });
+        gate.set_value();
+        CHECK_EQ(last.get(), 3);
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < 5s) {
+            {
+                std::lock_guard<std::mutex> lock(order_mutex);
+                if (order.size() == 24) {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(1ms);
+        }
+
+        std::lock_guard<std::mutex> lock(order_mutex);
+        REQUIRE_EQ(order.size(), 24);
+        CHECK_EQ(order.front(), netlib::TaskPriority::high);
+        auto first_low = std::find(order.begin(), order.end(), netlib::TaskPriority::low);
+        auto last_high = std::find(order.rbegin(), order.rend(), netlib::TaskPriority::high).base();
+        if (interval == 0) {
+            CHECK((std::is_sorted(order.begin(), order.end())));
+        } else {
+            // every 4th pick goes to the lowest lane with work, the high lane can't keep it waiting
+            CHECK((first_low < last_high));
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Timer wheel runs timers across all levels")
+{
+    netlib::timer_wheel wheel(1ms);
+    const auto start = netlib::timer_wheel::clock::now();
+    std::vector<int> order;
+    wheel.schedule(70000ms, [&]() { order.push_back(3); });
+    wheel.schedule(300ms, [&]() { order.push_back(2); });
+    wheel.schedule(5ms, [&]() { order.push_back(1); });
+    uint64_t cancelled = wheel.schedule(200ms, [&]() { order.push_back(-1); });
+    int periodic_runs = 0;
+    uint64_t periodic = wheel.schedule(100ms, [&]() { periodic_runs++; }, 100ms);
+    CHECK(wheel.cancel(cancelled));
+    CHECK_FALSE(wheel.cancel(cancelled));
+
+    // nothing runs early
+    CHECK_EQ(wheel.advance(start + 4ms), 0);
+    wheel.advance(start + 1000ms);
+    CHECK(order == std::vector<int>({1, 2}));
+    CHECK_GE(periodic_runs, 9);
+    CHECK(wheel.cancel(periodic));
+    wheel.advance(start + 70010ms);
+    CHECK(order == std::vector<int>({1, 2, 3}));
+    CHECK_LE(periodic_runs, 10);
+    CHECK_EQ(wheel.size(), 0);
+}
+
+TEST_CASE("Server closes idle connections and runs scheduled tasks")
+{
+    netlib::server server;
+    std::atomic<int> timed_out = 0;
+    server.register_callback_on_error([&](netlib::client_endpoint endpoint, std::error_condition ec) {
+        if (ec == std::errc::timed_out) {
+            timed_out++;
+        }
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP,
+                              {.idle_timeout = 200ms}));
+    std::atomic<int> ticks = 0;
+    uint64_t ticker = server.schedule_every(20ms, [&]() { ticks++; });
+    CHECK_NE(ticker, 0);
+
+    netlib::client idle_client;
+    netlib::client busy_client;
+    CHECK_FALSE(idle_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    CHECK_FALSE(busy_client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    for (int i = 0; i < 8; ++i) {
+        std::this_thread::sleep_for(50ms);
+        CHECK_FALSE(busy_client.send(std::vector<uint8_t>{1}, 100ms).second);
+    }
+    CHECK_EQ(timed_out, 1);
+    CHECK_EQ(server.get_client_count(), 1);
+    CHECK_GT(ticks, 5);
+    CHECK(server.cancel_timer(ticker));
+    int ticks_after_cancel = ticks;
+    std::this_thread::sleep_for(100ms);
+    CHECK_EQ(ticks, ticks_after_cancel);
+    server.stop();
+}
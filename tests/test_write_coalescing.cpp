@@ -0,0 +1,95 @@
+#include "../doctest/doctest/doctest.h"
+#include "../src/netlib.hpp"
+#include <atomic>
+
+using namespace std::chrono_literals;
+extern uint16_t test_port;
+
+TEST_CASE("Coalesced answers arrive complete and in order")
+{
+    constexpr std::size_t request_count = 200;
+    netlib::server server;
+    server.set_framer(std::make_shared<netlib::fixed_size_framer>(1));
+    server.register_callback_on_recv_span([&](netlib::client_endpoint endpoint, std::span<const uint8_t> data) -> netlib::server_response {
+        // the last request asks the server to hang up once everything went out
+        return {.answer = {data[0]}, .terminate = (data[0] == static_cast<uint8_t>(request_count - 1))};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, {.coalesce_writes = true}));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    std::vector<uint8_t> requests(request_count);
+    for (std::size_t i = 0; i < request_count; ++i) {
+        requests[i] = static_cast<uint8_t>(i);
+    }
+    CHECK_FALSE(client.send(requests, 100ms).second);
+    auto [answers, recv_error] = client.recv(request_count, 1000ms);
+    CHECK_FALSE(recv_error);
+    CHECK_EQ(answers, requests);
+    // the terminate was honoured after the coalesced flush
+    CHECK(client.recv(1, 1000ms).second);
+    server.stop();
+}
+
+TEST_CASE("Client gathers sends until flushed")
+{
+    std::atomic<std::size_t> received = 0;
+    netlib::server server;
+    server.register_callback_on_recv([&](netlib::client_endpoint endpoint, std::vector<uint8_t> data) -> netlib::server_response {
+        received += data.size();
+        return {.answer = {1}};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    CHECK_FALSE(client.set_write_coalescing(1024));
+    for (uint8_t i = 0; i < 10; ++i) {
+        CHECK_EQ(client.send(std::vector<uint8_t>{i}, 100ms).first, 1);
+    }
+    std::this_thread::sleep_for(100ms);
+    CHECK_EQ(received, 0);
+    auto [sent, flush_error] = client.flush(100ms);
+    CHECK_FALSE(flush_error);
+    CHECK_EQ(sent, 10);
+    CHECK_FALSE(client.recv(1, 1000ms).second);
+    CHECK_EQ(received, 10);
+
+    // receiving flushes on its own, so request/response works unchanged
+    CHECK_FALSE(client.send(std::vector<uint8_t>{1}, 100ms).second);
+    CHECK_FALSE(client.recv(1, 1000ms).second);
+    CHECK_EQ(received, 11);
+
+    // reaching the limit flushes as well
+    CHECK_FALSE(client.send(std::vector<uint8_t>(2048, 1), 100ms).second);
+    std::this_thread::sleep_for(100ms);
+    CHECK_EQ(received, 11 + 2048);
+    CHECK_FALSE(client.set_write_coalescing(0));
+    server.stop();
+}
+
+TEST_CASE("Frames held back while paused are handled once the coalesced flush resumes reading")
+{
+    std::atomic<std::size_t> handled = 0;
+    netlib::server server;
+    server.set_framer(std::make_shared<netlib::length_prefix_framer>(1));
+    server.register_callback_on_recv_span([&](netlib::client_endpoint endpoint, std::span<const uint8_t> data) -> netlib::server_response {
+        handled++;
+        // more than the watermark, so reading pauses after every frame until the flush
+        return {.answer = std::vector<uint8_t>(2000, data[0])};
+    });
+    CHECK_FALSE(server.create("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP,
+                              {.high_watermark = 1000, .coalesce_writes = true}));
+
+    netlib::client client;
+    CHECK_FALSE(client.connect("localhost", test_port, netlib::AddressFamily::IPv4, netlib::AddressProtocol::TCP, 1000ms));
+    // both frames in one write, so the second one is already buffered when reading pauses
+    CHECK_FALSE(client.send(std::vector<uint8_t>{1, 'a', 1, 'b'}, 100ms).second);
+    auto [answers, recv_error] = client.recv(4000, 1000ms);
+    CHECK_FALSE(recv_error);
+    REQUIRE_EQ(answers.size(), 4000);
+    CHECK_EQ(answers.front(), 'a');
+    CHECK_EQ(answers.back(), 'b');
+    CHECK_EQ(handled, 2);
+    server.stop();
+}